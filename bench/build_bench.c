@@ -0,0 +1,474 @@
+// End to end benchmark of nom builds on a synthetic source tree.
+//
+//   cc -O2 -o build_bench bench/build_bench.c
+//   ./build_bench --files 2000 --depth 3 --headers 200 --includes 8 --runs 5 > results.json
+//
+// The tree is generated in --dir (default `_bench`), and built with a fake compiler: this same
+// binary, called through a `fake-cc` symlink. It writes the objects and deps files without
+// compiling anything, so the timings are nom's own overhead plus process spawning.
+// Results are printed as JSON to stdout (or --out), one entry per scenario.
+
+// Rebuilds, e.g. after nom's headers change, keep the optimizations
+#define NOM_REBUILD_YOURSELF_FLAGS "-Wall", "-Wextra", "-pedantic", "-Wshadow", "-Wformat=2", "-pthread", "-Wno-unused-parameter", "-Wno-unused-function", "-Wno-implicit-fallthrough", "-O2"
+
+#define NOM_IMPLEMENTATION
+#include "../nom.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define BENCH_FAKE_CC "fake-cc"
+#define BENCH_DIR_FANOUT 8
+
+typedef struct BenchConfig {
+    size_t files;
+    size_t depth;
+    size_t headers;
+    size_t includes;
+    size_t runs;
+    const char *dir;
+    const char *out_path;
+} BenchConfig;
+
+typedef NomDarr(uint64_t) BenchSamples;
+
+// Timings and counters of the runs of a scenario
+typedef struct BenchResult {
+    const char *name;
+    BenchSamples samples_ns;
+    NomStats stats;             // Of the last run
+} BenchResult;
+
+typedef NomDarr(BenchResult) BenchResults;
+
+// Times the sources, objects and touched files are set to, so that rebuilds don't depend
+// on the 1s resolution of the modification times nom compares
+static time_t bench_src_time;
+static time_t bench_obj_time;
+static time_t bench_touch_time;
+
+//
+// Fake compiler
+//
+
+// Find the path of an included file in the include dirs
+static bool bench_find_include(NomCmdFlags include_dirs, NomStringView name, NomStringBuilder *path) {
+    for(size_t i = 0; i < include_dirs.len; ++i) {
+        nom_sb_reset(path);
+        nom_sb_append_str(path, include_dirs.items[i]);
+        nom_sb_append_char(path, '/');
+        nom_sb_append_sv(path, name);
+        nom_sb_append_null(path);
+        if(access(path->items, F_OK) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Handle `-c -MMD -o obj [-Idir...] src`, writing obj and its deps file from the quoted includes
+// of src, or `-o target obj...`, writing target
+static int bench_fake_cc(int argc, const char **argv) {
+    nom_log_set_level(NOM_ERROR);
+
+    const char *out_path = NULL;
+    bool compile = false;
+    NomCmdFlags include_dirs = {0};
+    for(int i = 1; i < argc; ++i) {
+        if(strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if(strcmp(argv[i], "-c") == 0) {
+            compile = true;
+        } else if(strncmp(argv[i], "-I", 2) == 0) {
+            nom_darr_append(&include_dirs, argv[i] + 2);
+        }
+    }
+    if(out_path == NULL) {
+        nom_log(NOM_ERROR, "fake-cc: no output file");
+        return 1;
+    }
+    if(!compile) {
+        return nom_write_file(out_path, nom_sv_from_str("fake executable\n")) ? 0 : 1;
+    }
+
+    const char *src_path = argv[argc - 1];
+    NomStringView src = nom_map_file(src_path);
+    if(src.data == NULL) {
+        nom_log(NOM_ERROR, "fake-cc: could not read `%s`", src_path);
+        return 1;
+    }
+
+    NomStringBuilder deps = {0};
+    nom_sb_append_str(&deps, out_path);
+    nom_sb_append_str(&deps, ": ");
+    nom_sb_append_str(&deps, src_path);
+
+    nom_sb_inline(include_path);
+    NomSvSplit lines = nom_sv_split(src, '\n');
+    NomStringView line;
+    NomStringView prefix = nom_sv_from_str("#include \"");
+    while(nom_sv_split_next(&lines, &line)) {
+        if(!nom_sv_starts_with(line, prefix)) continue;
+        line = nom_sv(line.data + prefix.len, line.len - prefix.len);
+        NomStringView name = nom_sv_chop_by_delim(&line, '"');
+        if(bench_find_include(include_dirs, name, &include_path)) {
+            nom_sb_append_str(&deps, " \\\n  ");
+            nom_sb_append_str(&deps, include_path.items);
+        }
+    }
+    nom_sb_append_nl(&deps);
+    nom_sb_free(&include_path);
+    nom_unmap_file(src);
+
+    nom_sb_inline(deps_path);
+    nom_sb_append_buf(&deps_path, out_path, strlen(out_path) - 2);
+    nom_sb_append_str(&deps_path, ".d");
+    nom_sb_append_null(&deps_path);
+
+    bool ok = nom_write_file(deps_path.items, nom_sb_to_sv(deps)) && nom_write_file(out_path, nom_sv_from_str("fake object\n"));
+    nom_sb_free(&deps_path);
+    nom_sb_free(&deps);
+    nom_darr_free(&include_dirs);
+    return ok ? 0 : 1;
+}
+
+//
+// Tree generation
+//
+
+static bool bench_set_mtime(const char *path, time_t mtime) {
+    struct timespec times[2] = {
+        { .tv_sec = mtime },
+        { .tv_sec = mtime },
+    };
+    if(utimensat(AT_FDCWD, path, times, 0) < 0) {
+        nom_log(NOM_ERROR, "could not set the modification time of `%s`: %s", path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+static bool bench_write_source(const char *path, NomStringView contents) {
+    return nom_write_file(path, contents) && bench_set_mtime(path, bench_src_time);
+}
+
+// Path of source `i`: `depth` levels of directories, spreading neighbours across them
+static void bench_source_path(NomStringBuilder *path, size_t i, size_t depth) {
+    nom_sb_reset(path);
+    nom_sb_append_str(path, "src");
+    size_t n = i;
+    for(size_t level = 0; level < depth; ++level) {
+        nom_sb_appendf(path, "/d%zu", n % BENCH_DIR_FANOUT);
+        n /= BENCH_DIR_FANOUT;
+    }
+}
+
+// Generate the tree. Every source includes header 0, plus `includes - 1` others picked at random.
+// Source 0 is the leaf touched by the benchmark.
+static bool bench_generate(const BenchConfig *config) {
+    if(!nom_delete("src") || !nom_mkdir("src/inc")) return false;
+
+    bool ok = true;
+    nom_sb_inline(path);
+    nom_sb_inline(contents);
+
+    for(size_t i = 0; i < config->headers && ok; ++i) {
+        nom_sb_reset(&path);
+        nom_sb_appendf(&path, "src/inc/h%zu.h", i);
+        nom_sb_append_null(&path);
+        nom_sb_reset(&contents);
+        nom_sb_appendf(&contents, "#ifndef H%zu_H\n#define H%zu_H\nint h%zu(int x);\n#endif\n", i, i, i);
+        ok = bench_write_source(path.items, nom_sb_to_sv(contents));
+    }
+
+    uint64_t rng = 0x9E3779B97F4A7C15ull;
+    for(size_t i = 0; i < config->files && ok; ++i) {
+        bench_source_path(&path, i, config->depth);
+        nom_sb_append_null(&path);
+        if(!nom_mkdir(path.items)) {
+            ok = false;
+            break;
+        }
+        path.len--;
+        nom_sb_appendf(&path, "/f%zu.c", i);
+        nom_sb_append_null(&path);
+
+        nom_sb_reset(&contents);
+        nom_sb_append_str(&contents, "#include \"inc/h0.h\"\n");
+        for(size_t j = 1; j < config->includes; ++j) {
+            rng ^= rng << 13;
+            rng ^= rng >> 7;
+            rng ^= rng << 17;
+            nom_sb_appendf(&contents, "#include \"inc/h%zu.h\"\n", (size_t) (rng % config->headers));
+        }
+        if(i == 0) {
+            nom_sb_append_str(&contents, "int main(void) { return h0(0); }\n");
+        } else {
+            nom_sb_appendf(&contents, "int f%zu(int x) { return h0(x) + %zu; }\n", i, i);
+        }
+        ok = bench_write_source(path.items, nom_sb_to_sv(contents));
+    }
+
+    nom_sb_free(&contents);
+    nom_sb_free(&path);
+    return ok;
+}
+
+static bool bench_backdate_obj(const char *path, NomFileType type, NomFileStats *ftw, va_list args) {
+    (void) ftw;
+    bool *ok = va_arg(args, bool *);
+    if(type == NOM_FILE_REG) {
+        *ok = bench_set_mtime(path, bench_obj_time) && *ok;
+    }
+    return true;
+}
+
+// Make the build look done a while ago, and undo the touches of previous runs
+static bool bench_settle(const NomCompileConfig *compile_config, const char *leaf) {
+    bool ok = true;
+    if(!nom_files_walk_tree(compile_config->obj_dir, bench_backdate_obj, &ok) || !ok) return false;
+    if(nom_file_exists(compile_config->target) && !bench_set_mtime(compile_config->target, bench_obj_time)) return false;
+    return bench_set_mtime(leaf, bench_src_time) && bench_set_mtime("src/inc/h0.h", bench_src_time);
+}
+
+//
+// Scenarios
+//
+
+typedef enum {
+    BENCH_COLD,
+    BENCH_NOOP,
+    BENCH_TOUCH_LEAF,
+    BENCH_TOUCH_HEADER,
+    BENCH_DB_COLD,
+    BENCH_DB_NOOP,
+    BENCH_CLEAN,
+    BENCH_SCENARIOS_COUNT,
+} BenchScenario;
+
+static const char *bench_scenario_names[BENCH_SCENARIOS_COUNT] = {
+    [BENCH_COLD]            = "cold",
+    [BENCH_NOOP]            = "noop",
+    [BENCH_TOUCH_LEAF]      = "touch_leaf",
+    [BENCH_TOUCH_HEADER]    = "touch_header",
+    [BENCH_DB_COLD]         = "db_cold",
+    [BENCH_DB_NOOP]         = "db_noop",
+    [BENCH_CLEAN]           = "clean",
+};
+
+// Get the tree in the state the scenario starts from. Not timed.
+static bool bench_prepare(BenchScenario scenario, const NomCompileConfig *compile_config, const char *leaf) {
+    switch(scenario) {
+        case BENCH_COLD:
+            return nom_clean(compile_config);
+        case BENCH_NOOP:
+            return bench_settle(compile_config, leaf);
+        case BENCH_TOUCH_LEAF:
+            return bench_settle(compile_config, leaf) && bench_set_mtime(leaf, bench_touch_time);
+        case BENCH_TOUCH_HEADER:
+            return bench_settle(compile_config, leaf) && bench_set_mtime("src/inc/h0.h", bench_touch_time);
+        case BENCH_DB_COLD:
+            return nom_delete("compile_commands.json");
+        case BENCH_DB_NOOP:
+            return nom_build_compilation_database(compile_config);
+        case BENCH_CLEAN:
+            return nom_compile(compile_config);
+        case BENCH_SCENARIOS_COUNT:
+            break;
+    }
+    NOM_ASSERT(0 && "unreachable");
+    return false; // Turn off gcc warning
+}
+
+static bool bench_run(BenchScenario scenario, const NomCompileConfig *compile_config) {
+    switch(scenario) {
+        case BENCH_COLD:
+        case BENCH_NOOP:
+        case BENCH_TOUCH_LEAF:
+        case BENCH_TOUCH_HEADER:
+            return nom_compile(compile_config);
+        case BENCH_DB_COLD:
+        case BENCH_DB_NOOP:
+            return nom_build_compilation_database(compile_config);
+        case BENCH_CLEAN:
+            return nom_clean(compile_config);
+        case BENCH_SCENARIOS_COUNT:
+            break;
+    }
+    NOM_ASSERT(0 && "unreachable");
+    return false; // Turn off gcc warning
+}
+
+NOM_DEFINE_CMP(bench_u64_cmp, uint64_t, a, b) {
+    return (*a > *b) - (*a < *b);
+}
+
+static void bench_append_json(NomStringBuilder *out, const BenchConfig *config, BenchResults results) {
+    nom_sb_appendf(out, "{\n  \"config\": {\"files\": %zu, \"depth\": %zu, \"headers\": %zu, \"includes\": %zu, \"runs\": %zu},\n",
+                   config->files, config->depth, config->headers, config->includes, config->runs);
+    nom_sb_append_str(out, "  \"scenarios\": [\n");
+    for(size_t i = 0; i < results.len; ++i) {
+        BenchResult *result = &results.items[i];
+        nom_darr_sort(&result->samples_ns, bench_u64_cmp);
+        BenchSamples samples = result->samples_ns;
+        NomStats stats = result->stats;
+
+        nom_sb_appendf(out, "    {\"name\": \"%s\", \"min_ms\": %.3f, \"median_ms\": %.3f, \"max_ms\": %.3f, ",
+                       result->name, samples.items[0]/1e6, samples.items[samples.len/2]/1e6, samples.items[samples.len - 1]/1e6);
+        nom_sb_appendf(out, "\"compiled\": %zu, \"stat_calls\": %zu, \"open_calls\": %zu, \"read_calls\": %zu, \"bytes_read\": %zu, ",
+                       stats.sources_compiled, stats.stat_calls, stats.open_calls, stats.read_calls, stats.bytes_read);
+        nom_sb_appendf(out, "\"procs_spawned\": %zu, \"wait_ms\": %.3f}%s\n",
+                       stats.procs_spawned, stats.wait_ns/1e6, i + 1 < results.len ? "," : "");
+    }
+    nom_sb_append_str(out, "  ]\n}\n");
+}
+
+static bool bench_parse_size(const char *arg, size_t *value) {
+    char *end;
+    unsigned long long n = strtoull(arg, &end, 10);
+    if(*arg == '\0' || *end != '\0') {
+        nom_log(NOM_ERROR, "invalid number `%s`", arg);
+        return false;
+    }
+    *value = n;
+    return true;
+}
+
+static bool bench_parse_args(int argc, const char **argv, BenchConfig *config) {
+    for(int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if(value == NULL) {
+            nom_log(NOM_ERROR, "missing value of `%s`", arg);
+            return false;
+        }
+        i++;
+
+        bool ok = true;
+        if(strcmp(arg, "--files") == 0)         ok = bench_parse_size(value, &config->files);
+        else if(strcmp(arg, "--depth") == 0)    ok = bench_parse_size(value, &config->depth);
+        else if(strcmp(arg, "--headers") == 0)  ok = bench_parse_size(value, &config->headers);
+        else if(strcmp(arg, "--includes") == 0) ok = bench_parse_size(value, &config->includes);
+        else if(strcmp(arg, "--runs") == 0)     ok = bench_parse_size(value, &config->runs);
+        else if(strcmp(arg, "--dir") == 0)      config->dir = value;
+        else if(strcmp(arg, "--out") == 0)      config->out_path = value;
+        else {
+            nom_log(NOM_ERROR, "unknown option `%s`", arg);
+            return false;
+        }
+        if(!ok) return false;
+    }
+
+    if(config->files == 0 || config->headers == 0 || config->includes == 0 || config->runs == 0) {
+        nom_log(NOM_ERROR, "--files, --headers, --includes and --runs must be at least 1");
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, const char **argv) {
+    const char *name = strrchr(argv[0], '/');
+    if(strcmp(name ? name + 1 : argv[0], BENCH_FAKE_CC) == 0) {
+        return bench_fake_cc(argc, argv);
+    }
+
+    nom_rebuild_yourself(argc, argv, __FILE__);
+#ifndef __OPTIMIZE__
+    nom_log(NOM_WARNING, "built without optimizations, timings won't match optimized builds");
+#endif
+
+    BenchConfig config = {
+        .files      = 1000,
+        .depth      = 2,
+        .headers    = 100,
+        .includes   = 8,
+        .runs       = 5,
+        .dir        = "_bench",
+        .out_path   = NULL,
+    };
+    if(!bench_parse_args(argc, argv, &config)) return 1;
+
+    char *self = realpath("/proc/self/exe", NULL);
+    if(self == NULL) {
+        nom_log(NOM_ERROR, "could not find the path of the benchmark binary: %s", strerror(errno));
+        return 1;
+    }
+    char *orig_cwd = config.out_path ? realpath(".", NULL) : NULL;
+
+    int ret = 0;
+    BenchResults results = {0};
+    NomStringBuilder out = {0};
+    NomCompileConfig compile_config = {
+        .cc         = "./" BENCH_FAKE_CC,
+        .target     = "a.out",
+        .src_dir    = "src",
+        .obj_dir    = "obj",
+    };
+    nom_cmd_flags_append(&compile_config.flags, "-Isrc");
+
+    nom_sb_inline(leaf);
+    bench_source_path(&leaf, 0, config.depth);
+    nom_sb_append_str(&leaf, "/f0.c");
+    nom_sb_append_null(&leaf);
+
+    if(!nom_mkdir(config.dir) || chdir(config.dir) < 0) {
+        nom_log(NOM_ERROR, "could not enter `%s`", config.dir);
+        nom_return_defer(1);
+    }
+    nom_delete(BENCH_FAKE_CC);
+    if(symlink(self, BENCH_FAKE_CC) < 0) {
+        nom_log(NOM_ERROR, "could not create `%s`: %s", BENCH_FAKE_CC, strerror(errno));
+        nom_return_defer(1);
+    }
+
+    time_t now = time(NULL);
+    bench_src_time = now - 3*3600;
+    bench_obj_time = now - 2*3600;
+    bench_touch_time = now - 3600;
+
+    nom_log(NOM_INFO, "generating %zu sources, %zu headers in `%s`", config.files, config.headers, config.dir);
+    nom_log_set_level(NOM_WARNING);
+    if(!bench_generate(&config)) nom_return_defer(1);
+
+    for(size_t scenario = 0; scenario < BENCH_SCENARIOS_COUNT; ++scenario) {
+        BenchResult result = { .name = bench_scenario_names[scenario] };
+        for(size_t run = 0; run < config.runs; ++run) {
+            if(!bench_prepare(scenario, &compile_config, leaf.items)) nom_return_defer(1);
+
+            nom_stats_reset();
+            uint64_t start_ns = nom_time_ns();
+            bool ok = bench_run(scenario, &compile_config);
+            uint64_t end_ns = nom_time_ns();
+            if(!ok) {
+                nom_log(NOM_ERROR, "scenario `%s` failed", result.name);
+                nom_return_defer(1);
+            }
+            nom_darr_append(&result.samples_ns, end_ns - start_ns);
+            result.stats = nom_stats;
+        }
+        nom_darr_append(&results, result);
+    }
+    nom_log_set_level(NOM_INFO);
+
+    bench_append_json(&out, &config, results);
+    if(orig_cwd) {
+        if(chdir(orig_cwd) < 0 || !nom_write_file(config.out_path, nom_sb_to_sv(out))) nom_return_defer(1);
+    } else {
+        fwrite(out.items, 1, out.len, stdout);
+    }
+
+defer:
+    nom_log_set_level(NOM_INFO);
+    for(size_t i = 0; i < results.len; ++i) {
+        nom_darr_free(&results.items[i].samples_ns);
+    }
+    nom_darr_free(&results);
+    nom_darr_free(&compile_config.flags);
+    nom_sb_free(&leaf);
+    nom_sb_free(&out);
+    free(orig_cwd);
+    free(self);
+    return ret;
+}
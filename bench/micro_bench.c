@@ -0,0 +1,369 @@
+// Microbenchmarks of nom's hot primitives: containers, string builders and the deps parser.
+//
+//   cc -O2 -o micro_bench bench/micro_bench.c
+//   ./micro_bench --save baseline.json              // On the base commit
+//   ./micro_bench --baseline baseline.json          // On the change, exits with 1 on regressions
+//
+// Each benchmark is calibrated to run for about MICRO_SAMPLE_NS per sample, warmed up, then
+// sampled --samples times. The median and 95th percentile time per iteration are reported, and
+// TSC ticks per iteration on x86 (reference cycles: they don't follow frequency scaling).
+// Options: --filter <substring>, --samples <n>, --threshold <percent> (default 10).
+
+// Rebuilds, e.g. after nom's headers change between --save and --baseline, keep the optimizations
+#define NOM_REBUILD_YOURSELF_FLAGS "-Wall", "-Wextra", "-pedantic", "-Wshadow", "-Wformat=2", "-pthread", "-Wno-unused-parameter", "-Wno-unused-function", "-Wno-implicit-fallthrough", "-O2"
+
+#define NOM_IMPLEMENTATION
+#include "../nom.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+    #define MICRO_HAS_CYCLES true
+    static uint64_t micro_cycles(void) { return __rdtsc(); }
+#else
+    #define MICRO_HAS_CYCLES false
+    static uint64_t micro_cycles(void) { return 0; }
+#endif
+
+// Target duration of a sample
+#define MICRO_SAMPLE_NS 2000000
+#define MICRO_WARMUP_SAMPLES 3
+
+// Results are fed here, so the benchmarked code isn't optimized away
+static volatile size_t micro_sink;
+
+typedef struct MicroBench {
+    const char *name;
+    const char *iteration;      // What one iteration does
+    void (*run)(size_t iters);
+} MicroBench;
+
+typedef struct MicroResult {
+    const char *name;
+    double median_ns;
+    double p95_ns;
+    double median_cycles;
+} MicroResult;
+
+typedef NomDarr(MicroResult) MicroResults;
+
+//
+// Inputs
+//
+
+static NomStringBuilder micro_deps_file;   // Like the output of gcc -MMD for a source with many includes
+static NomStringBuilder micro_long_path;   // A deep source path
+
+static void micro_make_inputs(void) {
+    static const char *dirs[] = { "src", "engine", "render", "backend", "vulkan", "pipeline", "shaders", "internal" };
+
+    for(size_t i = 0; i < NOM_ARRAY_LEN(dirs); ++i) {
+        nom_sb_append_str(&micro_long_path, dirs[i]);
+        nom_sb_append_char(&micro_long_path, '/');
+    }
+    nom_sb_append_str(&micro_long_path, "descriptor_set_layout_cache.c");
+
+    // 150 deps: the source, project headers and system headers, 2 per line as gcc writes them
+    nom_sb_append_str(&micro_deps_file, "obj/engine/render/backend/vulkan/pipeline/descriptor_set_layout_cache.o: ");
+    nom_sb_append_sb(&micro_deps_file, micro_long_path);
+    for(size_t i = 0; i < 150; ++i) {
+        nom_sb_append_str(&micro_deps_file, i % 2 == 0 ? " \\\n " : " ");
+        if(i % 3 == 0) {
+            nom_sb_appendf(&micro_deps_file, "/usr/include/x86_64-linux-gnu/bits/types/struct_header_%zu.h", i);
+        } else {
+            nom_sb_appendf(&micro_deps_file, "src/engine/render/backend/include/render_module_%zu/interface.h", i);
+        }
+    }
+    nom_sb_append_nl(&micro_deps_file);
+}
+
+//
+// Benchmarks
+//
+
+static void micro_darr_append(size_t iters) {
+    NomDarr(uint64_t) darr = {0};
+    for(size_t i = 0; i < iters; ++i) {
+        if(i % 1024 == 0) nom_darr_free(&darr);
+        nom_darr_append(&darr, i);
+    }
+    micro_sink = darr.len;
+    nom_darr_free(&darr);
+}
+
+static void micro_deq_grow(size_t iters) {
+    NomDeq(uint64_t) deq = {0};
+    for(size_t i = 0; i < iters; ++i) {
+        if(i % 1024 == 0) {
+            while(!nom_deq_is_empty(deq)) micro_sink = nom_deq_pop_l(&deq);
+            nom_deq_free(&deq);
+        }
+        nom_deq_push_r(&deq, i);
+    }
+    micro_sink = nom_deq_len(deq);
+    nom_deq_free(&deq);
+}
+
+static void micro_deq_fifo(size_t iters) {
+    NomDeq(uint64_t) deq = {0};
+    for(size_t i = 0; i < 64; ++i) nom_deq_push_r(&deq, i);
+    size_t sum = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        sum += nom_deq_pop_l(&deq);
+        nom_deq_push_r(&deq, i);
+    }
+    micro_sink = sum;
+    nom_deq_free(&deq);
+}
+
+static void micro_sb_append_str(size_t iters) {
+    NomStringBuilder sb = {0};
+    for(size_t i = 0; i < iters; ++i) {
+        if(i % 64 == 0) nom_sb_reset(&sb);
+        nom_sb_append_str(&sb, "src/engine/render/backend/vulkan/pipeline/descriptor_set_layout_cache.c");
+    }
+    micro_sink = sb.len;
+    nom_sb_free(&sb);
+}
+
+static void micro_sb_appendf(size_t iters) {
+    NomStringBuilder sb = {0};
+    for(size_t i = 0; i < iters; ++i) {
+        if(i % 64 == 0) nom_sb_reset(&sb);
+        nom_sb_appendf(&sb, "%s/%zu.o ", "obj/engine/render", i);
+    }
+    micro_sink = sb.len;
+    nom_sb_free(&sb);
+}
+
+static void micro_sb_append_u64(size_t iters) {
+    NomStringBuilder sb = {0};
+    for(size_t i = 0; i < iters; ++i) {
+        if(i % 256 == 0) nom_sb_reset(&sb);
+        nom_sb_append_u64(&sb, i*2654435761u);
+    }
+    micro_sink = sb.len;
+    nom_sb_free(&sb);
+}
+
+static void micro_sb_append_json_escaped(size_t iters) {
+    NomStringBuilder sb = {0};
+    NomStringView path = nom_sb_to_sv(micro_long_path);
+    for(size_t i = 0; i < iters; ++i) {
+        if(i % 64 == 0) nom_sb_reset(&sb);
+        nom_sb_append_json_escaped(&sb, path);
+    }
+    micro_sink = sb.len;
+    nom_sb_free(&sb);
+}
+
+static void micro_sv_chop_by_delim(size_t iters) {
+    size_t parts = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        NomStringView path = nom_sb_to_sv(micro_long_path);
+        while(path.len > 0) {
+            NomStringView part = nom_sv_chop_by_delim(&path, '/');
+            parts += part.len;
+        }
+    }
+    micro_sink = parts;
+}
+
+static void micro_parse_deps(size_t iters) {
+    NomArena arena = {0};
+    NomInterner paths = {0};
+    NomStringView deps_file = nom_sb_to_sv(micro_deps_file);
+    size_t deps = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        NomArenaMark mark = nom_arena_mark(&arena);
+        deps += internal_nom_parse_deps(&arena, &paths, deps_file).len;
+        nom_arena_rewind(&arena, mark);
+    }
+    micro_sink = deps;
+    nom_interner_free(&paths);
+    nom_arena_free(&arena);
+}
+
+static const MicroBench micro_benches[] = {
+    { "darr_append",            "append a u64, from empty every 1024",          micro_darr_append },
+    { "deq_grow",               "push_r a u64, from empty every 1024",          micro_deq_grow },
+    { "deq_fifo",               "pop_l + push_r on a 64 item queue",            micro_deq_fifo },
+    { "sb_append_str",          "append a long source path",                    micro_sb_append_str },
+    { "sb_appendf",             "append a formatted object path",               micro_sb_appendf },
+    { "sb_append_u64",          "append a 64-bit integer",                      micro_sb_append_u64 },
+    { "sb_append_json_escaped", "append a long source path, JSON escaped",      micro_sb_append_json_escaped },
+    { "sv_chop_by_delim",       "split a long source path into its components", micro_sv_chop_by_delim },
+    { "parse_deps",             "parse a 150 dependency .d file",               micro_parse_deps },
+};
+
+//
+// Harness
+//
+
+NOM_DEFINE_CMP(micro_double_cmp, double, a, b) {
+    return (*a > *b) - (*a < *b);
+}
+
+// Find the number of iterations that takes about MICRO_SAMPLE_NS
+static size_t micro_calibrate(const MicroBench *bench) {
+    size_t iters = 1;
+    while(true) {
+        uint64_t start_ns = nom_time_ns();
+        bench->run(iters);
+        uint64_t ns = nom_time_ns() - start_ns;
+        if(ns >= MICRO_SAMPLE_NS/2 || iters >= ((size_t) 1 << 40)) {
+            return ns > 0 ? (size_t) ((double) iters*MICRO_SAMPLE_NS/ns) + 1 : iters;
+        }
+        iters *= 2;
+    }
+}
+
+static MicroResult micro_measure(const MicroBench *bench, size_t samples) {
+    size_t iters = micro_calibrate(bench);
+    for(size_t i = 0; i < MICRO_WARMUP_SAMPLES; ++i) {
+        bench->run(iters);
+    }
+
+    NomDarr(double) ns = {0};
+    NomDarr(double) cycles = {0};
+    for(size_t i = 0; i < samples; ++i) {
+        uint64_t start_cycles = micro_cycles();
+        uint64_t start_ns = nom_time_ns();
+        bench->run(iters);
+        uint64_t end_ns = nom_time_ns();
+        uint64_t end_cycles = micro_cycles();
+        nom_darr_append(&ns, (double) (end_ns - start_ns)/iters);
+        nom_darr_append(&cycles, (double) (end_cycles - start_cycles)/iters);
+    }
+    nom_darr_sort(&ns, micro_double_cmp);
+    nom_darr_sort(&cycles, micro_double_cmp);
+
+    MicroResult result = {
+        .name           = bench->name,
+        .median_ns      = ns.items[samples/2],
+        .p95_ns         = ns.items[(95*samples + 99)/100 - 1],
+        .median_cycles  = cycles.items[samples/2],
+    };
+    nom_darr_free(&ns);
+    nom_darr_free(&cycles);
+    return result;
+}
+
+// Get the median of a benchmark from a file written with --save. Returns -1 if it isn't there.
+static double micro_baseline_median(NomStringView baseline, const char *name) {
+    NomSvSplit lines = nom_sv_split(baseline, '\n');
+    NomStringView line;
+    nom_sb_inline(key);
+    nom_sb_appendf(&key, "{\"name\": \"%s\", \"median_ns\": ", name);
+    double ret = -1;
+    while(nom_sv_split_next(&lines, &line)) {
+        line = nom_sv_trim(line);
+        if(nom_sv_starts_with(line, nom_sb_to_sv(key))) {
+            // Lines end with a comma or a newline, where strtod stops
+            ret = strtod(line.data + key.len, NULL);
+            break;
+        }
+    }
+    nom_sb_free(&key);
+    return ret;
+}
+
+static void micro_append_json(NomStringBuilder *out, MicroResults results) {
+    nom_sb_append_str(out, "[\n");
+    for(size_t i = 0; i < results.len; ++i) {
+        MicroResult result = results.items[i];
+        nom_sb_appendf(out, "    {\"name\": \"%s\", \"median_ns\": %.3f, \"p95_ns\": %.3f, \"median_cycles\": %.1f}%s\n",
+                       result.name, result.median_ns, result.p95_ns, result.median_cycles, i + 1 < results.len ? "," : "");
+    }
+    nom_sb_append_str(out, "]\n");
+}
+
+int main(int argc, const char **argv) {
+    nom_rebuild_yourself(argc, argv, __FILE__);
+#ifndef __OPTIMIZE__
+    nom_log(NOM_WARNING, "built without optimizations, timings won't match optimized builds");
+#endif
+
+    const char *filter = NULL;
+    const char *save_path = NULL;
+    const char *baseline_path = NULL;
+    size_t samples = 31;
+    double threshold = 10;
+    for(int i = 1; i + 1 < argc; i += 2) {
+        if(strcmp(argv[i], "--filter") == 0)            filter = argv[i + 1];
+        else if(strcmp(argv[i], "--save") == 0)         save_path = argv[i + 1];
+        else if(strcmp(argv[i], "--baseline") == 0)     baseline_path = argv[i + 1];
+        else if(strcmp(argv[i], "--samples") == 0)      samples = strtoul(argv[i + 1], NULL, 10);
+        else if(strcmp(argv[i], "--threshold") == 0)    threshold = strtod(argv[i + 1], NULL);
+        else {
+            nom_log(NOM_ERROR, "unknown option `%s`", argv[i]);
+            return 1;
+        }
+    }
+    if(argc % 2 == 0) {
+        nom_log(NOM_ERROR, "missing value of `%s`", argv[argc - 1]);
+        return 1;
+    }
+    if(samples == 0) {
+        nom_log(NOM_ERROR, "--samples must be at least 1");
+        return 1;
+    }
+
+    NomStringBuilder baseline = {0};
+    if(baseline_path) {
+        baseline = nom_read_file(baseline_path);
+        if(baseline.items == NULL) {
+            nom_log(NOM_ERROR, "could not read baseline `%s`", baseline_path);
+            return 1;
+        }
+    }
+
+    micro_make_inputs();
+
+    int ret = 0;
+    MicroResults results = {0};
+    printf("%-24s %12s %12s %10s%s\n", "benchmark", "median ns", "p95 ns", MICRO_HAS_CYCLES ? "cycles" : "", baseline_path ? "  vs baseline" : "");
+    for(size_t i = 0; i < NOM_ARRAY_LEN(micro_benches); ++i) {
+        const MicroBench *bench = &micro_benches[i];
+        if(filter && strstr(bench->name, filter) == NULL) {
+            continue;
+        }
+
+        MicroResult result = micro_measure(bench, samples);
+        nom_darr_append(&results, result);
+
+        printf("%-24s %12.2f %12.2f", result.name, result.median_ns, result.p95_ns);
+        if(MICRO_HAS_CYCLES) {
+            printf(" %10.1f", result.median_cycles);
+        } else {
+            printf(" %10s", "");
+        }
+        if(baseline_path) {
+            double base = micro_baseline_median(nom_sb_to_sv(baseline), result.name);
+            if(base <= 0) {
+                printf("  (new)");
+            } else {
+                double change = (result.median_ns - base)/base*100;
+                bool regression = change > threshold;
+                printf("  %+7.1f%%%s", change, regression ? "  REGRESSION" : "");
+                if(regression) ret = 1;
+            }
+        }
+        printf("   %s\n", bench->iteration);
+    }
+
+    if(save_path) {
+        NomStringBuilder out = {0};
+        micro_append_json(&out, results);
+        if(!nom_write_file(save_path, nom_sb_to_sv(out))) ret = 1;
+        nom_sb_free(&out);
+    }
+
+    nom_darr_free(&results);
+    nom_sb_free(&baseline);
+    nom_sb_free(&micro_deps_file);
+    nom_sb_free(&micro_long_path);
+    return ret;
+}
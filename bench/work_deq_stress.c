@@ -0,0 +1,200 @@
+// Stress test of the work stealing dequeue and the thread pool, meant to run under ThreadSanitizer.
+//
+//   cc -fsanitize=thread -O1 -g -pthread -o work_deq_stress bench/work_deq_stress.c
+//   ./work_deq_stress --items 200000 --thieves 4 --rounds 50 --threads 8
+//
+// The dequeue test has one owner pushing and popping against --thieves thieves, and checks that
+// every item is taken exactly once. The pool test runs a tree of recursively submitted tasks on
+// a new pool each round, and checks that every task ran exactly once.
+// Exits with 1 on a failed check. Data races are reported by ThreadSanitizer.
+
+// Rebuilds keep the sanitizer
+#define NOM_REBUILD_YOURSELF_FLAGS "-Wall", "-Wextra", "-pedantic", "-Wshadow", "-Wformat=2", "-pthread", "-Wno-unused-parameter", "-Wno-unused-function", "-Wno-implicit-fallthrough", "-fsanitize=thread", "-O1", "-g"
+
+#define NOM_IMPLEMENTATION
+#include "../nom.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// The owner pops one item every STRESS_POP_EVERY pushes, so pops race with steals
+#define STRESS_POP_EVERY 3
+#define STRESS_TREE_FANOUT 4
+#define STRESS_TREE_DEPTH 6
+
+typedef struct StressDeq {
+    NomWorkDeq deq;
+    atomic_uchar *taken;        // Times each item was taken, by index
+    atomic_bool done;
+    atomic_size_t stolen;
+} StressDeq;
+
+static void stress_take(StressDeq *s, void *item) {
+    // Items are their index + 1, since they can't be NULL
+    size_t index = (size_t)(uintptr_t) item - 1;
+    atomic_fetch_add_explicit(&s->taken[index], 1, memory_order_relaxed);
+}
+
+static void *stress_thief_run(void *arg) {
+    StressDeq *s = arg;
+    size_t stolen = 0;
+    for(;;) {
+        // Read `done` first: once it is set the owner has emptied the dequeue
+        bool done = atomic_load(&s->done);
+        void *item = nom_work_deq_steal(&s->deq);
+        if(item != NULL) {
+            stress_take(s, item);
+            stolen++;
+        } else if(done) {
+            break;
+        }
+    }
+    atomic_fetch_add(&s->stolen, stolen);
+    return NULL;
+}
+
+static bool stress_deq(size_t items, size_t thieves) {
+    StressDeq s = {0};
+    s.taken = NOM_MALLOC(items*sizeof(*s.taken));
+    NOM_ASSERT(s.taken != NULL && "Buy more RAM lol");
+    for(size_t i = 0; i < items; ++i) {
+        atomic_init(&s.taken[i], 0);
+    }
+
+    pthread_t *threads = NOM_MALLOC(thieves*sizeof(*threads));
+    NOM_ASSERT(threads != NULL && "Buy more RAM lol");
+    size_t started = 0;
+    for(; started < thieves; ++started) {
+        if(pthread_create(&threads[started], NULL, stress_thief_run, &s) != 0) {
+            nom_log(NOM_ERROR, "could not start thief %zu", started);
+            break;
+        }
+    }
+
+    size_t popped = 0;
+    for(size_t i = 0; i < items; ++i) {
+        nom_work_deq_push(&s.deq, (void *)(uintptr_t)(i + 1));
+        if(i % STRESS_POP_EVERY == 0) {
+            void *item = nom_work_deq_pop(&s.deq);
+            if(item != NULL) {
+                stress_take(&s, item);
+                popped++;
+            }
+        }
+    }
+    for(void *item; (item = nom_work_deq_pop(&s.deq)) != NULL;) {
+        stress_take(&s, item);
+        popped++;
+    }
+    atomic_store(&s.done, true);
+
+    for(size_t i = 0; i < started; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    bool ok = started == thieves;
+    size_t stolen = atomic_load(&s.stolen);
+    for(size_t i = 0; i < items; ++i) {
+        unsigned taken = atomic_load(&s.taken[i]);
+        if(taken != 1) {
+            nom_log(NOM_ERROR, "dequeue: item %zu was taken %u times", i, taken);
+            ok = false;
+            break;
+        }
+    }
+    if(popped + stolen != items) {
+        nom_log(NOM_ERROR, "dequeue: %zu items taken (%zu popped, %zu stolen), expected %zu", popped + stolen, popped, stolen, items);
+        ok = false;
+    }
+    nom_log(NOM_INFO, "dequeue: %zu items, %zu popped, %zu stolen by %zu thieves", items, popped, stolen, thieves);
+
+    nom_work_deq_free(&s.deq);
+    NOM_FREE(threads);
+    NOM_FREE(s.taken);
+    return ok;
+}
+
+typedef struct StressTree {
+    NomThreadPool *pool;
+    atomic_size_t ran;
+} StressTree;
+
+// Task of the tree. Its argument is the depth left, + 1 since it can't be NULL.
+static StressTree stress_tree;
+
+static void stress_tree_task(void *arg) {
+    size_t depth = (size_t)(uintptr_t) arg - 1;
+    atomic_fetch_add_explicit(&stress_tree.ran, 1, memory_order_relaxed);
+    if(depth == 0) return;
+    for(size_t i = 0; i < STRESS_TREE_FANOUT; ++i) {
+        nom_pool_submit(stress_tree.pool, stress_tree_task, (void *)(uintptr_t) depth);
+    }
+}
+
+static bool stress_pool(size_t rounds, size_t threads) {
+    // Tasks of a full tree: 1 + fanout + fanout^2 + ... + fanout^depth
+    size_t expected = 0;
+    for(size_t level = 0, width = 1; level <= STRESS_TREE_DEPTH; ++level, width *= STRESS_TREE_FANOUT) {
+        expected += width;
+    }
+
+    bool ok = true;
+    for(size_t round = 0; round < rounds; ++round) {
+        // Vary the thread count, down to a single thread
+        size_t pool_threads = 1 + round % threads;
+
+        NomThreadPool *pool = NOM_MALLOC(sizeof(*pool));
+        NOM_ASSERT(pool != NULL && "Buy more RAM lol");
+        nom_pool_init(pool, pool_threads);
+        stress_tree.pool = pool;
+        atomic_store(&stress_tree.ran, 0);
+
+        nom_pool_submit(pool, stress_tree_task, (void *)(uintptr_t)(STRESS_TREE_DEPTH + 1));
+        if(round % 2 == 0) {
+            nom_pool_wait(pool);
+        }
+        // Odd rounds leave the wait to nom_pool_free
+        nom_pool_free(pool);
+        NOM_FREE(pool);
+
+        size_t ran = atomic_load(&stress_tree.ran);
+        if(ran != expected) {
+            nom_log(NOM_ERROR, "pool: round %zu on %zu threads ran %zu tasks, expected %zu", round, pool_threads, ran, expected);
+            ok = false;
+        }
+    }
+    nom_log(NOM_INFO, "pool: %zu rounds of %zu tasks on up to %zu threads", rounds, expected, threads);
+    return ok;
+}
+
+int main(int argc, const char **argv) {
+    nom_rebuild_yourself(argc, argv, __FILE__);
+
+    size_t items = 200000;
+    size_t thieves = 4;
+    size_t rounds = 50;
+    size_t threads = 8;
+    for(int i = 1; i + 1 < argc; i += 2) {
+        if(strcmp(argv[i], "--items") == 0)             items = strtoul(argv[i + 1], NULL, 10);
+        else if(strcmp(argv[i], "--thieves") == 0)      thieves = strtoul(argv[i + 1], NULL, 10);
+        else if(strcmp(argv[i], "--rounds") == 0)       rounds = strtoul(argv[i + 1], NULL, 10);
+        else if(strcmp(argv[i], "--threads") == 0)      threads = strtoul(argv[i + 1], NULL, 10);
+        else {
+            nom_log(NOM_ERROR, "unknown option `%s`", argv[i]);
+            return 1;
+        }
+    }
+    if(argc % 2 == 0) {
+        nom_log(NOM_ERROR, "missing value of `%s`", argv[argc - 1]);
+        return 1;
+    }
+    if(threads == 0 || threads > NOM_POOL_MAX_THREADS) {
+        nom_log(NOM_ERROR, "--threads must be between 1 and %d", NOM_POOL_MAX_THREADS);
+        return 1;
+    }
+
+    bool ok = stress_deq(items, thieves);
+    ok = stress_pool(rounds, threads) && ok;
+    nom_log(ok ? NOM_INFO : NOM_ERROR, ok ? "all checks passed" : "some checks failed");
+    return ok ? 0 : 1;
+}
@@ -1,6 +1,7 @@
 #define NOB_IMPLEMENTATION
 #include "nom.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 void set_flags(NomCompileConfig *compile_config) {
@@ -38,15 +39,27 @@ void set_flags(NomCompileConfig *compile_config) {
 
 #define DEFAULT_CMD "compile"
 int main(int argc, const char **argv) {
+    // Record a timeline of the build with: NOM_TRACE=trace.json ./build
+    const char *trace_path = getenv("NOM_TRACE");
+    if(trace_path) nom_trace_start(trace_path);
+
     nom_rebuild_yourself(argc, argv, __FILE__);
 
     const char *cmd = argc > 1 ? argv[1] : DEFAULT_CMD;
 
     NomCompileConfig compile_config = {
-            .cc         = "gcc",
-            .target     = "a.out",
-            .src_dir    = "src",
-            .obj_dir    = "obj",
+            .cc                 = "gcc",
+            .target             = "a.out",
+            .src_dir            = "src",
+            .obj_dir            = "obj",
+            .progress           = true,
+            // Print timings, counters and the most expensive files with: NOM_STATS=1 ./build
+            .stats              = getenv("NOM_STATS") != NULL,
+            .report_top_jobs    = getenv("NOM_STATS") ? 10 : 0,
+            // Log why each file is rebuilt with: NOM_EXPLAIN=1 ./build
+            .explain            = getenv("NOM_EXPLAIN") != NULL,
+            // Compile the sources of each directory in bundles of 8 with: NOM_UNITY=8 ./build
+            .unity_size         = getenv("NOM_UNITY") ? strtoul(getenv("NOM_UNITY"), NULL, 10) : 0,
     };
     set_flags(&compile_config);
 
@@ -68,5 +81,7 @@ int main(int argc, const char **argv) {
 
     nom_darr_free(&compile_config.flags);
 
+    if(trace_path && !nom_trace_stop()) ret = 1;
+
     return ret;
 }
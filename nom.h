@@ -2,11 +2,18 @@
 #define NOM_H
 
 #include "src/nom_defs.h"
+#include "src/nom_arena.h"
 #include "src/nom_log.h"
 #include "src/nom_sb.h"
 #include "src/nom_dequeue.h"
+#include "src/nom_work_deq.h"
+#include "src/nom_pool.h"
+#include "src/nom_hashmap.h"
+#include "src/nom_interner.h"
 #include "src/nom_cmd.h"
 #include "src/nom_files.h"
+#include "src/nom_stats.h"
+#include "src/nom_trace.h"
 #include "src/nom_sv.h"
 #include "src/nom_compile.h"
 
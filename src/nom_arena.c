@@ -0,0 +1,123 @@
+#ifndef NOM_ARENA_C
+#define NOM_ARENA_C
+
+#include "nom_arena.h"
+
+#include <string.h>
+
+#define INTERNAL_NOM_ARENA_ALIGN _Alignof(max_align_t)
+
+struct NomArenaBlock {
+    NomArenaBlock *next;
+    size_t len;
+    size_t cap;
+    _Alignas(max_align_t) char data[];
+};
+
+static NomArenaBlock *internal_nom_arena_block_new(size_t size) {
+    size_t cap = size > NOM_ARENA_BLOCK_SIZE ? size : NOM_ARENA_BLOCK_SIZE;
+    NomArenaBlock *block = NOM_MALLOC(sizeof(*block) + cap);
+    NOM_ASSERT(block != NULL && "malloc failed");
+    block->next = NULL;
+    block->len = 0;
+    block->cap = cap;
+    return block;
+}
+
+void *nom_arena_alloc(NomArena *arena, size_t size) {
+    size = (size + INTERNAL_NOM_ARENA_ALIGN - 1) & ~(INTERNAL_NOM_ARENA_ALIGN - 1);
+
+    if(arena->last == NULL) {
+        arena->first = arena->last = internal_nom_arena_block_new(size);
+    }
+
+    // Move on to the following blocks (kept by a reset or rewind) until the allocation fits
+    while(arena->last->cap - arena->last->len < size) {
+        NomArenaBlock *next = arena->last->next;
+        if(next == NULL || next->cap < size) {
+            NomArenaBlock *block = internal_nom_arena_block_new(size);
+            block->next = next;
+            arena->last->next = block;
+            next = block;
+        }
+        next->len = 0;
+        arena->last = next;
+    }
+
+    void *ret = arena->last->data + arena->last->len;
+    arena->last->len += size;
+    return ret;
+}
+
+void *nom_arena_realloc(NomArena *arena, void *ptr, size_t old_size, size_t new_size) {
+    if(ptr == NULL) {
+        return nom_arena_alloc(arena, new_size);
+    }
+
+    NomArenaBlock *last = arena->last;
+    size_t old_aligned = (old_size + INTERNAL_NOM_ARENA_ALIGN - 1) & ~(INTERNAL_NOM_ARENA_ALIGN - 1);
+    size_t new_aligned = (new_size + INTERNAL_NOM_ARENA_ALIGN - 1) & ~(INTERNAL_NOM_ARENA_ALIGN - 1);
+
+    if((char *) ptr + old_aligned == last->data + last->len && last->len - old_aligned + new_aligned <= last->cap) {
+        // Last allocation -> Resize in place
+        last->len = last->len - old_aligned + new_aligned;
+        return ptr;
+    }
+
+    if(new_size <= old_size) {
+        return ptr;
+    }
+
+    void *ret = nom_arena_alloc(arena, new_size);
+    memcpy(ret, ptr, old_size);
+    return ret;
+}
+
+char *nom_arena_strdup(NomArena *arena, const char *str) {
+    return nom_arena_strndup(arena, str, strlen(str));
+}
+
+char *nom_arena_strndup(NomArena *arena, const char *buf, size_t len) {
+    char *ret = nom_arena_alloc(arena, len + 1);
+    memcpy(ret, buf, len);
+    ret[len] = 0;
+    return ret;
+}
+
+NomArenaMark nom_arena_mark(const NomArena *arena) {
+    NomArenaMark ret = {
+        .block = arena->last,
+        .len = arena->last ? arena->last->len : 0,
+    };
+    return ret;
+}
+
+void nom_arena_rewind(NomArena *arena, NomArenaMark mark) {
+    if(mark.block == NULL) {
+        nom_arena_reset(arena);
+        return;
+    }
+
+    arena->last = mark.block;
+    arena->last->len = mark.len;
+}
+
+void nom_arena_reset(NomArena *arena) {
+    arena->last = arena->first;
+    if(arena->last) {
+        arena->last->len = 0;
+    }
+}
+
+void nom_arena_free(NomArena *arena) {
+    NomArenaBlock *block = arena->first;
+    while(block) {
+        NomArenaBlock *next = block->next;
+        NOM_FREE(block);
+        block = next;
+    }
+    arena->first = NULL;
+    arena->last = NULL;
+}
+
+#endif //NOM_ARENA_C
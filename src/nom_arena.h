@@ -0,0 +1,57 @@
+#ifndef NOM_ARENA_H
+#define NOM_ARENA_H
+
+#include "nom_defs.h"
+
+#include <stddef.h>
+
+// Minimum size of each memory block of an arena
+#ifndef NOM_ARENA_BLOCK_SIZE
+    #define NOM_ARENA_BLOCK_SIZE (64*1024)
+#endif
+
+typedef struct NomArenaBlock NomArenaBlock;
+
+// Region allocator. Memory is bumped out of big blocks allocated with NOM_MALLOC, and it is
+// all released at once with nom_arena_reset, nom_arena_rewind or nom_arena_free.
+typedef struct NomArena {
+    NomArenaBlock *first;
+    NomArenaBlock *last;
+} NomArena;
+
+// Checkpoint of an arena
+typedef struct NomArenaMark {
+    NomArenaBlock *block;
+    size_t len;
+} NomArenaMark;
+
+// Allocate memory from the arena, aligned for any type
+void *nom_arena_alloc(NomArena *arena, size_t size);
+
+// Grow (or shrink) memory allocated from the arena. Done in place if it was the last allocation.
+void *nom_arena_realloc(NomArena *arena, void *ptr, size_t old_size, size_t new_size);
+
+// Copy a NULL-terminated string into the arena
+char *nom_arena_strdup(NomArena *arena, const char *str);
+
+// Copy a sized buffer into the arena as a NULL-terminated string
+char *nom_arena_strndup(NomArena *arena, const char *buf, size_t len);
+
+// Get a checkpoint of the current arena state
+NomArenaMark nom_arena_mark(const NomArena *arena);
+
+// Release everything allocated after a checkpoint. Its memory is reused.
+void nom_arena_rewind(NomArena *arena, NomArenaMark mark);
+
+// Release everything allocated from the arena, without freeing its memory
+void nom_arena_reset(NomArena *arena);
+
+// Free all the memory of the arena
+// It may be reused
+void nom_arena_free(NomArena *arena);
+
+#endif //NOM_ARENA_H
+
+#ifdef NOM_IMPLEMENTATION
+#include "nom_arena.c"
+#endif //NOM_IMPLEMENTATION
@@ -4,10 +4,12 @@
 #include "nom_darr.h"
 
 #include "nom_log.h"
+#include "nom_stats.h"
 
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <sys/resource.h>
 #include <sys/wait.h>
 #include <fcntl.h>
 
@@ -30,6 +32,7 @@ void nom_cmd_append_flags(NomCmd *cmd, NomCmdFlags flags) {
 void nom_cmd_reset(NomCmd *cmd) {
     cmd->out_fd = 0;
     cmd->out_path = NULL;
+    cmd->err_fd = 0;
     nom_darr_reset(cmd);
 }
 
@@ -46,13 +49,7 @@ void nom_cmd_render(NomCmd cmd, NomStringBuilder *render) {
         if(i > 0){
             nom_sb_append_char(render, ' ');
         }
-        if(!strchr(arg, ' ')) {
-            nom_sb_append_str(render, arg);
-        } else {
-            nom_sb_append_char(render, '\'');
-            nom_sb_append_str(render, arg);
-            nom_sb_append_char(render, '\'');
-        }
+        nom_sb_append_shell_escaped(render, nom_sv_from_str(arg));
     }
 }
 
@@ -64,12 +61,15 @@ NomProc nom_cmd_run_async(NomCmd cmd) {
         return NOM_INVALID_PROC;
     }
 
-    NomStringBuilder sb = {0};
-    nom_cmd_render(cmd, &sb);
-    nom_sb_append_null(&sb);
-    nom_log(NOM_INFO, "CMD: %s", sb.items);
-    nom_sb_free(&sb);
+    if(nom_log_enabled(NOM_INFO)) {
+        nom_sb_inline(sb);
+        nom_cmd_render(cmd, &sb);
+        nom_sb_append_null(&sb);
+        nom_log(NOM_INFO, "CMD: %s", sb.items);
+        nom_sb_free(&sb);
+    }
 
+    NOM_STAT_INC(procs_spawned);
     pid_t child_pid = fork();
     if(child_pid < 0) {
         nom_log(NOM_ERROR, "Could not fork child process: %s", strerror(errno));
@@ -97,6 +97,16 @@ NomProc nom_cmd_run_async(NomCmd cmd) {
             }
             close(out_fd);
         }
+        if(cmd.err_fd != STDIN_FILENO && cmd.err_fd != STDERR_FILENO) {
+            if(dup2(cmd.err_fd, STDERR_FILENO) == -1) {
+                nom_log(NOM_ERROR, "Could not set fd `%d` for command errors: %s", cmd.err_fd, strerror(errno));
+                exit(1);
+            }
+            if(cmd.err_fd != STDOUT_FILENO) {
+                // Not when it is stdout, as in `2>&1`
+                close(cmd.err_fd);
+            }
+        }
 
         nom_cmd_append(&cmd, NULL);
         if(execvp(cmd.items[0], cmd.items) < 0) {
@@ -109,34 +119,70 @@ NomProc nom_cmd_run_async(NomCmd cmd) {
     return child_pid;
 }
 
+// Check the wait status of a process. Returns false if it hasn't finished yet.
+static bool internal_nom_proc_finished(int wait_status, bool *success) {
+    if(WIFEXITED(wait_status)) {
+        int exit_status = WEXITSTATUS(wait_status);
+        if(exit_status != 0) {
+            nom_log(NOM_ERROR, "command exited with exit code %d", exit_status);
+            *success = false;
+        } else {
+            *success = true;
+        }
+        return true;
+    }
+
+    if(WIFSIGNALED(wait_status)) {
+        nom_log(NOM_ERROR, "command process was terminated by %s", strsignal(WTERMSIG(wait_status)));
+        *success = false;
+        return true;
+    }
+
+    return false;
+}
+
+static uint64_t internal_nom_timeval_ns(struct timeval tv) {
+    return (uint64_t) tv.tv_sec*1000000000 + (uint64_t) tv.tv_usec*1000;
+}
+
 bool nom_proc_wait(NomProc proc) {
+    return nom_proc_wait_usage(proc, NULL);
+}
+
+bool nom_proc_wait_usage(NomProc proc, NomProcUsage *usage) {
+    if(usage) {
+        memset(usage, 0, sizeof(*usage));
+    }
     if(proc == NOM_INVALID_PROC) {
         return false;
     }
 
+    bool success = false;
     while(true) {
         int wait_status = 0;
-        if(waitpid(proc, &wait_status, 0) < 0) {
+        struct rusage rusage;
+        uint64_t wait_start_ns = NOM_STATS_ENABLED ? nom_time_ns() : 0;
+        int ret = wait4(proc, &wait_status, 0, &rusage);
+        NOM_STAT_ADD(wait_ns, nom_time_ns() - wait_start_ns);
+        if(ret < 0) {
+            if(errno == EINTR) continue;
             nom_log(NOM_ERROR, "could not wait on command (pid %d): %s", proc, strerror(errno));
             return false;
         }
 
-        if(WIFEXITED(wait_status)) {
-            int exit_status = WEXITSTATUS(wait_status);
-            if(exit_status != 0) {
-                nom_log(NOM_ERROR, "command exited with exit code %d", exit_status);
-                return false;
+        if(internal_nom_proc_finished(wait_status, &success)) {
+            if(usage) {
+                usage->user_ns              = internal_nom_timeval_ns(rusage.ru_utime);
+                usage->sys_ns               = internal_nom_timeval_ns(rusage.ru_stime);
+                usage->max_rss_kb           = rusage.ru_maxrss;
+                usage->minor_faults         = rusage.ru_minflt;
+                usage->major_faults         = rusage.ru_majflt;
+                usage->voluntary_switches   = rusage.ru_nvcsw;
+                usage->involuntary_switches = rusage.ru_nivcsw;
             }
-            break;
-        }
-
-        if(WIFSIGNALED(wait_status)) {
-            nom_log(NOM_ERROR, "command process was terminated by %s", strsignal(WTERMSIG(wait_status)));
-            return false;
+            return success;
         }
     }
-
-    return true;
 }
 
 bool nom_procs_wait(NomProcs procs) {
@@ -147,6 +193,52 @@ bool nom_procs_wait(NomProcs procs) {
     return success;
 }
 
+bool nom_procs_wait_any(NomProcs *procs, NomProc *finished, bool *success, NomProcUsage *usage) {
+    if(procs->len == 0) {
+        return false;
+    }
+
+    // Processes that failed to start are done already
+    for(size_t i = 0; i < procs->len; ++i) {
+        if(procs->items[i] == NOM_INVALID_PROC) {
+            nom_darr_swap_remove(procs, i);
+            *finished = NOM_INVALID_PROC;
+            *success = nom_proc_wait_usage(NOM_INVALID_PROC, usage);
+            return true;
+        }
+    }
+
+    while(true) {
+        // Peek which child finished without reaping it, as it may not be one of ours
+        siginfo_t info = {0};
+        uint64_t wait_start_ns = NOM_STATS_ENABLED ? nom_time_ns() : 0;
+        int ret = waitid(P_ALL, 0, &info, WEXITED | WNOWAIT);
+        NOM_STAT_ADD(wait_ns, nom_time_ns() - wait_start_ns);
+        if(ret < 0) {
+            if(errno == EINTR) continue;
+            break;
+        }
+
+        for(size_t i = 0; i < procs->len; ++i) {
+            NomProc proc = procs->items[i];
+            if(proc == info.si_pid) {
+                nom_darr_swap_remove(procs, i);
+                *finished = proc;
+                *success = nom_proc_wait_usage(proc, usage);
+                return true;
+            }
+        }
+
+        // Some other child of ours: leave it to its owner
+        break;
+    }
+
+    // Can't tell which one will finish first. Wait for them in order.
+    *finished = nom_darr_pop(procs);
+    *success = nom_proc_wait_usage(*finished, usage);
+    return true;
+}
+
 bool nom_cmd_run_sync(NomCmd cmd) {
     NomProc p = nom_cmd_run_async(cmd);
     return nom_proc_wait(p);
@@ -4,6 +4,7 @@
 #include "nom_sb.h"
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include <sys/types.h>
 
@@ -13,9 +14,21 @@ typedef pid_t NomProc;
 
 typedef NomDarr(NomProc) NomProcs;
 
+// Resources used by a finished process, from wait4
+typedef struct NomProcUsage {
+    uint64_t user_ns;               // CPU time in user mode
+    uint64_t sys_ns;                // CPU time in kernel mode
+    size_t max_rss_kb;              // Peak resident memory
+    size_t minor_faults;            // Page faults served without I/O
+    size_t major_faults;            // Page faults that needed I/O
+    size_t voluntary_switches;      // Context switches from blocking
+    size_t involuntary_switches;    // Context switches from preemption
+} NomProcUsage;
+
 typedef struct NomCmd {
     int out_fd;
     const char *out_path;
+    int err_fd;             // If set, the command's stderr is redirected to it
     nom_darr_embed(char *);
 } NomCmd;
 
@@ -60,9 +73,17 @@ NomProc nom_cmd_run_async(NomCmd cmd);
 // Wait for process
 bool nom_proc_wait(NomProc proc);
 
+// Wait for process, and get the resources it used. `usage` is zeroed if it can't be waited on.
+bool nom_proc_wait_usage(NomProc proc, NomProcUsage *usage);
+
 // Wait for multiple processes
 bool nom_procs_wait(NomProcs procs);
 
+// Wait for whichever of `procs` finishes first, and remove it from them. Returns false when there
+// are no processes left. `finished` is set to the process, and `success` to whether it exited with 0.
+// If `usage` isn't NULL it is set to the resources the process used.
+bool nom_procs_wait_any(NomProcs *procs, NomProc *finished, bool *success, NomProcUsage *usage);
+
 // Run command synchronously
 bool nom_cmd_run_sync(NomCmd cmd);
 
@@ -3,97 +3,269 @@
 
 #include "nom_compile.h"
 
+#include <fcntl.h>
+#include <inttypes.h>
+#include <sys/ioctl.h>
 #include <unistd.h>
 
-// Gets a single row of dependencies from a dep file as an array
-// Modifies `deps_file`
-static NomConstStrDarr internal_nom_parse_deps(char *deps_file) {
-    NomConstStrDarr ret = {0};
+typedef NomDarr(NomInternId) InternalNomDeps;
 
-    if(deps_file == NULL) {
-        return ret;
-    }
+typedef struct InternalNomStatEntry {
+    time_t updated_at;
+    bool checked;
+    bool failed;
+} InternalNomStatEntry;
 
-    char *s = deps_file;
+// Dependency paths, interned, with their modification times indexed by ID.
+// Each dependency is stat'ed at most once per build, no matter how many deps files list it.
+typedef struct InternalNomStatCache {
+    NomInterner paths;
+    NomDarr(InternalNomStatEntry) entries;
+} InternalNomStatCache;
 
-    // Find dependencies section after ':'
-    for(; *s != 0 && *s != '\n' && *s != ':'; s++) {
-        // Escape newline
-        if(*s == '\\') {
-            s++;
-            if(*s == '\n') continue;
-        }
-    }
+static void internal_nom_stat_cache_free(InternalNomStatCache *cache) {
+    nom_interner_free(&cache->paths);
+    nom_darr_free(&cache->entries);
+}
 
-    if(*s == 0 || *s == '\n') {
-        // No ':' found -> No dependency section
-        return ret;
+// Undo the make escapes of a path in a deps file (`\ `, `\#` and `$$`). The copy, if needed, is allocated from `arena`.
+static NomStringView internal_nom_unescape_dep(NomArena *arena, NomStringView dep) {
+    if(nom_sv_find_any(dep, "\\$") == NOM_SV_NPOS) {
+        return dep;
     }
 
-    // Skip ':'
-    s++;
+    char *buf = nom_arena_alloc(arena, dep.len);
+    size_t len = 0;
+    for(size_t i = 0; i < dep.len; ++i) {
+        bool escape = i + 1 < dep.len && (
+                (dep.data[i] == '\\' && (dep.data[i + 1] == ' ' || dep.data[i + 1] == '#')) ||
+                (dep.data[i] == '$' && dep.data[i + 1] == '$'));
+        if(escape) i++;
+        buf[len++] = dep.data[i];
+    }
+    return nom_sv(buf, len);
+}
 
-    for(; *s != 0 && *s != '\n'; s++) {
-        // Ignore spaces
-        if(*s == ' ') continue;
+// Gets a single row of dependencies from a dep file as an array of interned path IDs
+// The array is allocated from `arena`
+static InternalNomDeps internal_nom_parse_deps(NomArena *arena, NomInterner *paths, NomStringView deps_file) {
+    InternalNomDeps ret = {0};
 
-        // Escape newline
-        if(*s == '\\') {
-            s++;
-            if(*s == '\n') continue;
-        }
+    if(deps_file.data == NULL) {
+        return ret;
+    }
 
-        // New dep
-        nom_darr_append(&ret, s);
+    // Find dependencies section after the target's ':'
+    NomStringView line = deps_file;
+    NomStringView token;
+    bool found_target = false;
+    while(!found_target && nom_sv_next_token(&line, &token)) {
+        found_target = nom_sv_ends_with(token, nom_sv_from_str(":"));
+    }
 
-        // Reach end of dep
-        for(; *s != 0 && *s != '\n' && *s != ' '; s++);
-        if(*s == 0 || *s == '\n') {
-            // End of dep is EOF or EOL
-            *s = 0;
-            return ret;
-        }
+    if(!found_target) {
+        // No ':' found -> No dependency section
+        return ret;
+    }
 
-        // *s == ' ' -> Normal end of dep
-        *s = 0;
+    while(nom_sv_next_token(&line, &token)) {
+        NomStringView dep = internal_nom_unescape_dep(arena, token);
+        nom_darr_append_arena(arena, &ret, nom_intern(paths, dep));
     }
 
     return ret;
 }
 
-bool nom_needs_rebuild(const char *target_path, const char * const dependencies[], size_t dependencies_count) {
+// Get the last modification time of a target. Returns false if it must be rebuilt regardless of its dependencies.
+static bool internal_nom_target_updated_at(const char *target_path, time_t *updated_at) {
     struct stat statbuf;
+    NOM_STAT_INC(stat_calls);
     if(stat(target_path, &statbuf) < 0) {
-        if(errno == ENOENT) {
-            // if output does not exist it must be rebuilt
-            return true;
+        if(errno != ENOENT) {
+            nom_log(NOM_ERROR, "could not stat `%s`: %s", target_path, strerror(errno));
         }
-        nom_log(NOM_ERROR, "could not stat `%s`: %s", target_path, strerror(errno));
+        // if output does not exist it must be rebuilt
+        return false;
+    }
+    *updated_at = statbuf.st_mtime;
+    return true;
+}
+
+// Get the last modification time of a dependency. Returns false if it can't be stat'ed.
+static bool internal_nom_dep_updated_at(const char *dependency, time_t *updated_at) {
+    struct stat statbuf;
+    NOM_STAT_INC(stat_calls);
+    if(stat(dependency, &statbuf) < 0) {
+        // non-existing input is an error because it is needed for building in the first place
+        nom_log(NOM_ERROR, "could not stat `%s`: %s", dependency, strerror(errno));
+        return false;
+    }
+    *updated_at = statbuf.st_mtime;
+    return true;
+}
+
+// Account for a dependency of a target that failed to stat or is newer than it. With a reason,
+// all the dependencies are checked, and the newest one is kept as the cause.
+static void internal_nom_reason_add_dep(NomRebuildReason *reason, const char *dependency, bool failed, time_t updated_at) {
+    if(reason->cause == NOM_REBUILD_DEP_MISSING) {
+        // A missing dependency trumps newer ones
+        return;
+    }
+    if(failed) {
+        reason->cause = NOM_REBUILD_DEP_MISSING;
+        reason->dependency = dependency;
+        return;
+    }
+    reason->newer_count++;
+    if(reason->cause != NOM_REBUILD_DEP_NEWER || updated_at > reason->dependency_mtime) {
+        reason->cause = NOM_REBUILD_DEP_NEWER;
+        reason->dependency = dependency;
+        reason->dependency_mtime = updated_at;
+    }
+}
+
+bool nom_needs_rebuild(const char *target_path, const char * const dependencies[], size_t dependencies_count) {
+    return nom_needs_rebuild_explain(target_path, dependencies, dependencies_count, NULL);
+}
+
+bool nom_needs_rebuild_explain(const char *target_path, const char * const dependencies[], size_t dependencies_count, NomRebuildReason *reason) {
+    if(reason) {
+        memset(reason, 0, sizeof(*reason));
+    }
+
+    time_t target_updated_at;
+    if(!internal_nom_target_updated_at(target_path, &target_updated_at)) {
+        if(reason) reason->cause = NOM_REBUILD_NO_OUTPUT;
         return true;
     }
-    time_t target_updated_at = statbuf.st_mtime;
+    if(reason) reason->target_mtime = target_updated_at;
 
     for(size_t i = 0; i < dependencies_count; ++i) {
-        const char *dependency = dependencies[i];
+        time_t updated_at = 0;
+        bool failed = !internal_nom_dep_updated_at(dependencies[i], &updated_at);
+        if(failed || updated_at > target_updated_at) {
+            if(!reason) return true;
+            internal_nom_reason_add_dep(reason, dependencies[i], failed, updated_at);
+        }
+    }
+
+    return reason && reason->cause != NOM_REBUILD_NONE;
+}
+
+const char *nom_rebuild_cause_str(NomRebuildCause cause) {
+    switch(cause) {
+        case NOM_REBUILD_NONE:          return "up to date";
+        case NOM_REBUILD_NO_OUTPUT:     return "output missing";
+        case NOM_REBUILD_NO_DEPS_FILE:  return "deps file missing";
+        case NOM_REBUILD_DEP_MISSING:   return "dependency missing";
+        case NOM_REBUILD_DEP_NEWER:     return "dependency newer";
+        case NOM_REBUILD_CAUSES_COUNT:  break;
+    }
+    NOM_ASSERT(0 && "unreachable");
+    return ""; // Turn off gcc warning
+}
+
+// Append a modification time as local date and time
+static void internal_nom_append_mtime(NomStringBuilder *sb, time_t mtime) {
+    struct tm tm;
+    char buf[32];
+    if(localtime_r(&mtime, &tm) == NULL || strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm) == 0) {
+        nom_sb_append_i64(sb, mtime);
+        return;
+    }
+    nom_sb_append_str(sb, buf);
+}
+
+void nom_rebuild_reason_log(const char *target_path, NomRebuildReason reason) {
+    nom_sb_inline(sb);
+    switch(reason.cause) {
+        case NOM_REBUILD_NONE:
+            nom_sb_append_str(&sb, "is up to date");
+            break;
+        case NOM_REBUILD_NO_OUTPUT:
+            nom_sb_append_str(&sb, "does not exist");
+            break;
+        case NOM_REBUILD_NO_DEPS_FILE:
+            nom_sb_append_str(&sb, "has no deps file");
+            break;
+        case NOM_REBUILD_DEP_MISSING:
+            nom_sb_appendf(&sb, "depends on `%s`, which can't be stat'ed", reason.dependency);
+            break;
+        case NOM_REBUILD_DEP_NEWER:
+            nom_sb_appendf(&sb, "is older than `%s` (", reason.dependency);
+            internal_nom_append_mtime(&sb, reason.target_mtime);
+            nom_sb_append_str(&sb, " < ");
+            internal_nom_append_mtime(&sb, reason.dependency_mtime);
+            nom_sb_append_char(&sb, ')');
+            if(reason.newer_count > 1) {
+                nom_sb_appendf(&sb, " and %zu more dependencies", reason.newer_count - 1);
+            }
+            break;
+        case NOM_REBUILD_CAUSES_COUNT:
+            NOM_ASSERT(0 && "unreachable");
+    }
+    nom_sb_append_null(&sb);
+    nom_log(NOM_INFO, "explain: `%s` %s", target_path, sb.items);
+    nom_sb_free(&sb);
+}
+
+// Get the stat cache entry of a dependency, stat'ing it if it wasn't yet
+static InternalNomStatEntry internal_nom_stat_cached(InternalNomStatCache *cache, NomInternId dep) {
+    if(cache->entries.len < nom_interner_count(&cache->paths)) {
+        nom_darr_resize(&cache->entries, nom_interner_count(&cache->paths));
+    }
+
+    InternalNomStatEntry *entry = &cache->entries.items[dep];
+    if(!entry->checked) {
+        const char *dependency = nom_interner_str(&cache->paths, dep);
+        struct stat statbuf;
+        entry->checked = true;
+        NOM_STAT_INC(stat_calls);
         if(stat(dependency, &statbuf) < 0) {
             // non-existing input is an error because it is needed for building in the first place
             nom_log(NOM_ERROR, "could not stat `%s`: %s", dependency, strerror(errno));
-            return true;
+            entry->failed = true;
+        } else {
+            entry->updated_at = statbuf.st_mtime;
         }
-        time_t dependency_updated_at = statbuf.st_mtime;
+    }
+    return *entry;
+}
+
+// Same as nom_needs_rebuild_explain, but for dependencies parsed from a deps file. `cause` is set
+// to the ID of the dependency that is the cause, if any.
+static bool internal_nom_deps_need_rebuild(InternalNomStatCache *cache, const char *target_path, InternalNomDeps deps, NomRebuildReason *reason, NomInternId *cause) {
+    if(reason) {
+        memset(reason, 0, sizeof(*reason));
+    }
+
+    time_t target_updated_at;
+    if(!internal_nom_target_updated_at(target_path, &target_updated_at)) {
+        if(reason) reason->cause = NOM_REBUILD_NO_OUTPUT;
+        return true;
+    }
+    if(reason) reason->target_mtime = target_updated_at;
+
+    for(size_t i = 0; i < deps.len; ++i) {
+        InternalNomStatEntry entry = internal_nom_stat_cached(cache, deps.items[i]);
         // if dependency is fresher => rebuild
-        if(dependency_updated_at > target_updated_at) {
-            return true;
+        if(entry.failed || entry.updated_at > target_updated_at) {
+            if(!reason) return true;
+            const char *dependency = reason->dependency;
+            internal_nom_reason_add_dep(reason, nom_interner_str(&cache->paths, deps.items[i]), entry.failed, entry.updated_at);
+            if(reason->dependency != dependency) {
+                *cause = deps.items[i];
+            }
         }
     }
 
-    return false;
+    return reason && reason->cause != NOM_REBUILD_NONE;
 }
 
 void internal_nom_do_rebuild(int argc, const char **argv, const char *src_path, bool run) {
     const char *binary_path = argv[0];
 
-    NomStringBuilder sb = {0};
+    nom_sb_inline(sb);
     nom_sb_append_str(&sb, binary_path);
     nom_sb_append_str(&sb, ".old");
     nom_sb_append_null(&sb);
@@ -135,6 +307,7 @@ void nom_rebuild_yourself(int argc, const char **argv, const char *src_path) {
 #endif
 
     const char *binary_path = argv[0];
+    NomTraceSpan span = nom_trace_begin("self-rebuild check");
 
     int pipe_fd[2];
     if(pipe(pipe_fd) == -1) {
@@ -160,219 +333,1214 @@ void nom_rebuild_yourself(int argc, const char **argv, const char *src_path) {
     if(src_deps_file.items == NULL) {
         needs_rebuild = true;
     } else {
-        nom_sb_append_null(&src_deps_file);
-        NomConstStrDarr src_deps = internal_nom_parse_deps(src_deps_file.items);
-        needs_rebuild = nom_needs_rebuild(binary_path, src_deps.items, src_deps.len);
-        nom_darr_free(&src_deps);
+        NomArena arena = {0};
+        InternalNomStatCache cache = {0};
+        InternalNomDeps src_deps = internal_nom_parse_deps(&arena, &cache.paths, nom_sb_to_sv(src_deps_file));
+        needs_rebuild = internal_nom_deps_need_rebuild(&cache, binary_path, src_deps, NULL, NULL);
+        internal_nom_stat_cache_free(&cache);
+        nom_arena_free(&arena);
         nom_sb_free(&src_deps_file);
     }
 
+    nom_trace_end(span);
+
     if(needs_rebuild) {
         internal_nom_do_rebuild(argc, argv, src_path, true);
     }
 }
 
-static bool internal_nom_src_needs_rebuild(const char *obj_path) {
+// Scratch memory is taken from `arena`, and released before returning
+// With a reason, see internal_nom_deps_need_rebuild
+static bool internal_nom_src_needs_rebuild(NomArena *arena, InternalNomStatCache *cache, const char *obj_path, NomRebuildReason *reason, NomInternId *cause) {
+    NomArenaMark mark = nom_arena_mark(arena);
+
     // Dependency path
     NomStringBuilder deps_path = {0};
-    nom_sb_append_str(&deps_path, obj_path);
+    nom_sb_append_str_arena(arena, &deps_path, obj_path);
     deps_path.len -= 2;
-    nom_sb_append_str(&deps_path, ".d");
-    nom_sb_append_null(&deps_path);
+    nom_sb_append_str_arena(arena, &deps_path, ".d");
+    nom_sb_append_null_arena(arena, &deps_path);
 
     // Try to find cached deps file
-    NomStringBuilder deps_file = nom_read_file(deps_path.items);
-    if(deps_file.items == NULL) {
+    NomStringView deps_file = nom_map_file(deps_path.items);
+    if(deps_file.data == NULL) {
         // No cached deps file, or we got an error while fetching it. Either way we need to rebuild.
-        nom_sb_free(&deps_file);
-        nom_sb_free(&deps_path);
+        if(reason) {
+            time_t updated_at;
+            memset(reason, 0, sizeof(*reason));
+            reason->cause = internal_nom_target_updated_at(obj_path, &updated_at) ? NOM_REBUILD_NO_DEPS_FILE : NOM_REBUILD_NO_OUTPUT;
+        }
+        nom_arena_rewind(arena, mark);
         return true;
     }
 
     // Deps file found. Check if object file it's still valid.
-    nom_sb_append_null(&deps_file);
-    NomConstStrDarr deps = internal_nom_parse_deps(deps_file.items);
-    bool ret = nom_needs_rebuild(obj_path, deps.items, deps.len);
+    InternalNomDeps deps = internal_nom_parse_deps(arena, &cache->paths, deps_file);
+    bool ret = internal_nom_deps_need_rebuild(cache, obj_path, deps, reason, cause);
 
-    nom_darr_free(&deps);
-    nom_sb_free(&deps_file);
-    nom_sb_free(&deps_path);
+    nom_unmap_file(deps_file);
+    nom_arena_rewind(arena, mark);
     return ret;
 }
 
-typedef struct InternalNomCompileFileState {
+typedef struct InternalNomSource {
+    char *src_path;
+    char *obj_path;
+    size_t obj_dir_len; // Length of the directory part of obj_path
+} InternalNomSource;
+
+typedef NomDarr(InternalNomSource) InternalNomSources;
+
+// Running compile job
+typedef struct InternalNomJob {
+    const char *src_path;
+    size_t id;          // Position in the stale list, from 1, shown in log records
+    uint64_t start_ns;
+    size_t slot;        // Reused once the job finishes, so concurrent jobs never share one
+} InternalNomJob;
+
+#define INTERNAL_NOM_COMPILE_TIMES_FILE ".nom_compile_times"
+
+// Compile times of the previous builds, by source path. Lines are "<nanoseconds> <path>".
+typedef NomHashMap(NomStringView, uint64_t) InternalNomCompileTimes;
+
+// Progress of the compile jobs, shown as a [n/N] status line. The ETA weighs every job by its
+// compile time in previous builds. Jobs without one count as the average job.
+typedef struct InternalNomProgress {
+    bool enabled;
+    bool tty;                   // Update a single line in place
+    size_t columns;             // Terminal width, when known
+    size_t total;
+    size_t done;
+    uint64_t start_ns;
+    uint64_t *estimates_ns;     // By job ID - 1. 0 if unknown.
+    uint64_t known_done_ns;     // Estimated time of the finished jobs with an estimate
+    uint64_t known_left_ns;     // Estimated time of the unfinished jobs with an estimate
+    size_t known_count;
+    size_t unknown_done;
+    size_t unknown_left;
+    uint64_t actual_done_ns;    // Wall time of the finished jobs
+    bool shown;
+    FILE *output;               // In TTY mode, the stderr of the jobs and nom's log, shown above the status line
+    off_t output_shown;         // Bytes of `output` already shown
+    bool log_captured;
+    FILE *log_stream;           // To restore once done
+} InternalNomProgress;
+
+// Rebuilds by cause for explain mode, and by dependency ID for the dependency causes
+typedef struct InternalNomExplain {
+    size_t causes[NOM_REBUILD_CAUSES_COUNT];
+    NomDarr(size_t) deps;
+} InternalNomExplain;
+
+// Per build data lives in `arena`, and is released in one shot at the end of the build
+typedef struct InternalNomCompileState {
     const NomCompileConfig *config;
+    NomArena arena;
+    InternalNomStatCache stat_cache;
     NomCmd cmd;
     NomProcs procs;
+    InternalNomSources sources;
+    InternalNomSources stale;               // Sources that need to be compiled
     NomConstStrDarr objs;
-} InternalNomCompileFileState;
-
-static void internal_nom_compile_file(const char *path, NomFileType type, NomFileStats *ftw, InternalNomCompileFileState *state) {
-    if(type != NOM_FILE_REG || strcmp(path + ftw->path_len - 2, ".c") != 0) {
+    NomHashMap(NomProc, InternalNomJob) jobs;
+    NomCompileJobs finished;                // Jobs reaped, with src_path in `arena`
+    NomDarr(size_t) free_slots;
+    size_t slots;
+    NomStringView times_file;               // Mapped, keys of `times` point into it
+    InternalNomCompileTimes times;
+    uint64_t *job_ns;                       // Compile time by job ID - 1. 0 if it failed.
+    InternalNomProgress progress;
+    InternalNomExplain explain;
+} InternalNomCompileState;
+
+static void internal_nom_collect_source(const char *path, NomFileType type, NomFileStats *ftw, InternalNomCompileState *state) {
+    if(type != NOM_FILE_REG || !nom_sv_ends_with(nom_sv(path, ftw->path_len), nom_sv_from_str(".c"))) {
         // Only process '.c' files
         return;
     }
 
     const NomCompileConfig *config = state->config;
+    NomArena *arena = &state->arena;
+
+    // Src File
+    char *src_path = nom_arena_strndup(arena, path, ftw->path_len);
 
     // Dir
     NomStringBuilder obj_path = {0};
-    nom_sb_append_str(&obj_path, config->obj_dir);
-    nom_sb_append_buf(&obj_path, path + ftw->base_root, ftw->base_name - ftw->base_root - 1);
-    nom_sb_append_null(&obj_path);
-    nom_mkdir(obj_path.items);
-
-    // Src File
-    obj_path.len--;
-    nom_sb_append_char(&obj_path, '/');
-    nom_sb_append_str(&obj_path, path + ftw->base_name);
+    nom_sb_append_str_arena(arena, &obj_path, config->obj_dir);
+    nom_sb_append_buf_arena(arena, &obj_path, path + ftw->base_root, ftw->base_name - ftw->base_root - 1);
+    size_t obj_dir_len = obj_path.len;
 
     // Obj File
+    nom_sb_append_char_arena(arena, &obj_path, '/');
+    nom_sb_append_str_arena(arena, &obj_path, path + ftw->base_name);
     obj_path.len -= 2;
-    nom_sb_append_str(&obj_path, ".o");
-    nom_sb_append_null(&obj_path);
-    nom_darr_append(&state->objs, obj_path.items);
+    nom_sb_append_str_arena(arena, &obj_path, ".o");
+    nom_sb_append_null_arena(arena, &obj_path);
+
+    InternalNomSource source = {
+        .src_path       = src_path,
+        .obj_path       = obj_path.items,
+        .obj_dir_len    = obj_dir_len,
+    };
+    nom_darr_append_arena(arena, &state->sources, source);
+}
+
+static bool internal_nom_walkable_collect_source(const char *path, NomFileType type, NomFileStats *ftw, va_list args) {
+    InternalNomCompileState *state = va_arg(args, InternalNomCompileState *);
+
+    internal_nom_collect_source(path, type, ftw, state);
+
+    return true;
+}
+
+// Order sources by object directory, parents first, then by object path
+NOM_DEFINE_CMP(internal_nom_source_cmp, InternalNomSource, source_a, source_b) {
+    size_t dir_len = source_a->obj_dir_len < source_b->obj_dir_len ? source_a->obj_dir_len : source_b->obj_dir_len;
+    int cmp = memcmp(source_a->obj_path, source_b->obj_path, dir_len);
+    if(cmp != 0) return cmp;
+    if(source_a->obj_dir_len != source_b->obj_dir_len) return source_a->obj_dir_len < source_b->obj_dir_len ? -1 : 1;
+    return strcmp(source_a->obj_path + dir_len, source_b->obj_path + dir_len);
+}
+
+// Create each object directory exactly once. Sources must be sorted by internal_nom_source_cmp.
+static bool internal_nom_create_obj_dirs(const NomCompileConfig *config, InternalNomSources sources) {
+    size_t root_len = strlen(config->obj_dir);
+    const InternalNomSource *prev = NULL;
 
-    // Compile if it needs rebuild
-    if(internal_nom_src_needs_rebuild(obj_path.items)) {
-        NomCmd cmd = state->cmd;
-        nom_cmd_append(&cmd, config->cc, "-c", "-MMD", "-o", obj_path.items);
-        nom_cmd_append_flags(&cmd, config->flags);
-        nom_cmd_append(&cmd, path);
-        nom_darr_append(&state->procs, nom_cmd_run_async(cmd));
-        nom_cmd_reset(&cmd);
-        state->cmd = cmd;
+    for(size_t i = 0; i < sources.len; ++i) {
+        InternalNomSource *source = &sources.items[i];
+        if(source->obj_dir_len == root_len) {
+            // Root obj dir is already created
+            continue;
+        }
+        if(prev && prev->obj_dir_len == source->obj_dir_len && memcmp(prev->obj_path, source->obj_path, source->obj_dir_len) == 0) {
+            // Same dir as the previous source
+            continue;
+        }
+        prev = source;
+
+        // Temporarily cut the obj path at its directory
+        source->obj_path[source->obj_dir_len] = 0;
+        bool ok = nom_mkdir(source->obj_path);
+        source->obj_path[source->obj_dir_len] = '/';
+        if(!ok) return false;
     }
+
+    return true;
 }
 
-static bool internal_nom_walkable_compile_file(const char *path, NomFileType type, NomFileStats *ftw, va_list args) {
-    InternalNomCompileFileState *state = va_arg(args, InternalNomCompileFileState *);
+#define INTERNAL_NOM_UNITY_PREFIX "__nom_unity_"
+#define INTERNAL_NOM_UNITY_HEADER "// Generated by nom, do not edit\n"
+#define INTERNAL_NOM_UNITY_NONE SIZE_MAX
 
-    internal_nom_compile_file(path, type, ftw, state);
+// Member of a unity bundle by include path
+typedef NomHashMap(NomStringView, size_t) InternalNomUnityIndex;
 
+static bool internal_nom_unity_excluded(const NomCompileConfig *config, const char *src_path) {
+    for(size_t i = 0; i < config->unity_exclude.len; ++i) {
+        if(strcmp(config->unity_exclude.items[i], src_path) == 0) return true;
+    }
+    return false;
+}
+
+// `<obj dir>/__nom_unity_<k><ext>`, for the object directory of `dir`
+static char *internal_nom_unity_path(NomArena *arena, InternalNomSource dir, size_t k, const char *ext) {
+    NomStringBuilder path = {0};
+    nom_sb_append_buf_arena(arena, &path, dir.obj_path, dir.obj_dir_len);
+    nom_sb_append_str_arena(arena, &path, "/" INTERNAL_NOM_UNITY_PREFIX);
+    char index[32];
+    snprintf(index, sizeof(index), "%zu", k);
+    nom_sb_append_str_arena(arena, &path, index);
+    nom_sb_append_str_arena(arena, &path, ext);
+    nom_sb_append_null_arena(arena, &path);
+    return path.items;
+}
+
+// Prefix that makes relative source paths relative to the object directory of `dir` instead, so
+// the bundles don't depend on where the tree is. Falls back to the working directory when the
+// object directory is absolute or goes up with `..`.
+static bool internal_nom_unity_include_prefix(NomArena *arena, InternalNomSource dir, char **cwd, NomStringBuilder *prefix) {
+    NomStringView obj_dir = nom_sv(dir.obj_path, dir.obj_dir_len);
+    bool relative = obj_dir.len > 0 && obj_dir.data[0] != '/';
+    size_t depth = 0;
+    NomSvSplit parts = nom_sv_split(obj_dir, '/');
+    NomStringView part;
+    while(relative && nom_sv_split_next(&parts, &part)) {
+        if(part.len == 0 || nom_sv_eq(part, nom_sv_from_str("."))) continue;
+        if(nom_sv_eq(part, nom_sv_from_str(".."))) {
+            relative = false;
+        } else {
+            depth++;
+        }
+    }
+
+    if(relative) {
+        for(size_t i = 0; i < depth; ++i) {
+            nom_sb_append_str_arena(arena, prefix, "../");
+        }
+        return true;
+    }
+    if(*cwd == NULL && (*cwd = nom_get_cwd()) == NULL) {
+        return false;
+    }
+    nom_sb_append_str_arena(arena, prefix, *cwd);
+    nom_sb_append_char_arena(arena, prefix, '/');
     return true;
 }
 
+// Bundle the sources of one object directory, adding the bundles and the sources compiled on
+// their own to `bundled`.
+//
+// Membership is read back from the current bundles, `__nom_unity_0.c` up to the first missing
+// one, and sources stay in their bundle. New sources fill the first bundles with room, so adding
+// or removing a source only changes the bundle it goes in or out of. A bundle that is rewritten
+// has its object deleted: the old object may have the same mtime as the new bundle.
+static bool internal_nom_unity_bundle_dir(InternalNomCompileState *state, const InternalNomSource *sources, size_t count, char **cwd, InternalNomUnityIndex *index, InternalNomSources *bundled, size_t *bundles) {
+    const NomCompileConfig *config = state->config;
+    NomArena *arena = &state->arena;
+    InternalNomSource dir = sources[0];
+
+    InternalNomSource *members = nom_arena_alloc(arena, count*sizeof(*members));
+    size_t members_count = 0;
+    for(size_t i = 0; i < count; ++i) {
+        if(internal_nom_unity_excluded(config, sources[i].src_path)) {
+            nom_darr_append_arena(arena, bundled, sources[i]);
+        } else {
+            members[members_count++] = sources[i];
+        }
+    }
+    if(members_count == 1) {
+        // A lone source is compiled on its own
+        nom_darr_append_arena(arena, bundled, members[0]);
+        members_count = 0;
+    }
+
+    NomStringBuilder prefix = {0};
+    if(members_count > 0 && !internal_nom_unity_include_prefix(arena, dir, cwd, &prefix)) {
+        return false;
+    }
+    NomStringView *includes = nom_arena_alloc(arena, count*sizeof(*includes));
+    size_t *bundle_of = nom_arena_alloc(arena, count*sizeof(*bundle_of));
+    nom_hm_reset(index);
+    for(size_t i = 0; i < members_count; ++i) {
+        const char *src_path = members[i].src_path;
+        if(src_path[0] == '/') {
+            includes[i] = nom_sv_from_str(src_path);
+        } else {
+            NomStringBuilder include = {0};
+            nom_sb_append_sv_arena(arena, &include, nom_sb_to_sv(prefix));
+            nom_sb_append_str_arena(arena, &include, src_path);
+            includes[i] = nom_sb_to_sv(include);
+        }
+        bundle_of[i] = INTERNAL_NOM_UNITY_NONE;
+        nom_hm_put(index, includes[i], i);
+    }
+
+    // Current bundles
+    NomDarr(size_t) sizes = {0};
+    NomStringView include_start = nom_sv_from_str("#include \"");
+    for(size_t k = 0;; ++k) {
+        errno = 0;
+        NomStringView old = nom_map_file(internal_nom_unity_path(arena, dir, k, ".c"));
+        if(old.data == NULL && errno == ENOENT) break;
+        if(old.data == NULL && errno != 0) return false;
+
+        size_t size = 0;
+        NomSvSplit lines = nom_sv_split(old, '\n');
+        NomStringView line;
+        while(nom_sv_split_next(&lines, &line)) {
+            if(line.len <= include_start.len || !nom_sv_starts_with(line, include_start) || line.data[line.len - 1] != '"') {
+                continue;
+            }
+            size_t *member = nom_hm_get(index, nom_sv(line.data + include_start.len, line.len - include_start.len - 1));
+            if(member != NULL && bundle_of[*member] == INTERNAL_NOM_UNITY_NONE && size < config->unity_size) {
+                bundle_of[*member] = k;
+                size++;
+            }
+        }
+        nom_unmap_file(old);
+        nom_darr_append_arena(arena, &sizes, size);
+    }
+
+    // New members, in source order
+    size_t open = 0;
+    for(size_t i = 0; i < members_count; ++i) {
+        if(bundle_of[i] != INTERNAL_NOM_UNITY_NONE) continue;
+        while(open < sizes.len && sizes.items[open] >= config->unity_size) open++;
+        if(open == sizes.len) {
+            nom_darr_append_arena(arena, &sizes, 0);
+        }
+        bundle_of[i] = open;
+        sizes.items[open]++;
+    }
+
+    // Bundles left empty at the end are deleted. The ones before stay as placeholders, so the
+    // bundles after them are still found.
+    while(sizes.len > 0 && sizes.items[sizes.len - 1] == 0) {
+        size_t k = sizes.len - 1;
+        if(!nom_delete(internal_nom_unity_path(arena, dir, k, ".c"))) return false;
+        if(!nom_delete(internal_nom_unity_path(arena, dir, k, ".o"))) return false;
+        if(!nom_delete(internal_nom_unity_path(arena, dir, k, ".d"))) return false;
+        sizes.len--;
+    }
+
+    nom_sb_inline(contents);
+    bool ok = true;
+    for(size_t k = 0; k < sizes.len && ok; ++k) {
+        nom_sb_reset(&contents);
+        nom_sb_append_str(&contents, INTERNAL_NOM_UNITY_HEADER);
+        for(size_t i = 0; i < members_count; ++i) {
+            if(bundle_of[i] != k) continue;
+            nom_sb_append_str(&contents, "#include \"");
+            nom_sb_append_sv(&contents, includes[i]);
+            nom_sb_append_str(&contents, "\"\n");
+        }
+
+        char *src_path = internal_nom_unity_path(arena, dir, k, ".c");
+        char *obj_path = internal_nom_unity_path(arena, dir, k, ".o");
+
+        // Compared here first, so up to date bundles aren't logged on every build
+        NomStringView old = nom_map_file(src_path);
+        if(old.data == NULL || !nom_sv_eq(old, nom_sb_to_sv(contents))) {
+            ok = nom_update_file(src_path, nom_sb_to_sv(contents)) && nom_delete(obj_path);
+            if(ok && sizes.items[k] == 0) {
+                ok = nom_delete(internal_nom_unity_path(arena, dir, k, ".d"));
+            }
+        }
+        nom_unmap_file(old);
+
+        if(ok && sizes.items[k] > 0) {
+            InternalNomSource bundle = {
+                .src_path       = src_path,
+                .obj_path       = obj_path,
+                .obj_dir_len    = dir.obj_dir_len,
+            };
+            nom_darr_append_arena(arena, bundled, bundle);
+            (*bundles)++;
+        }
+    }
+    nom_sb_free(&contents);
+
+    return ok;
+}
+
+// Replace the sources with unity bundles of up to config->unity_size sources of the same
+// directory. Excluded sources, and the only source of a directory, are compiled on their own.
+// Sources must be sorted by internal_nom_source_cmp.
+static bool internal_nom_unity_bundle(InternalNomCompileState *state) {
+    InternalNomSources sources = state->sources;
+    bool ret = true;
+
+    char *cwd = NULL;
+    InternalNomUnityIndex index = {.base.key = NOM_HASH_KEY_SV};
+    InternalNomSources bundled = {0};
+    size_t bundles = 0;
+
+    size_t i = 0;
+    while(i < sources.len) {
+        // Sources of the same object directory
+        size_t end = i + 1;
+        while(end < sources.len && sources.items[end].obj_dir_len == sources.items[i].obj_dir_len
+                && memcmp(sources.items[end].obj_path, sources.items[i].obj_path, sources.items[i].obj_dir_len) == 0) {
+            end++;
+        }
+        if(!internal_nom_unity_bundle_dir(state, &sources.items[i], end - i, &cwd, &index, &bundled, &bundles)) nom_return_defer(false);
+        i = end;
+    }
+
+    size_t alone = bundled.len - bundles;
+    nom_log(NOM_INFO, "unity build: %zu sources in %zu bundles, %zu on their own", sources.len - alone, bundles, alone);
+    state->sources = bundled;
+
+defer:
+    nom_hm_free(&index);
+    NOM_FREE(cwd);
+    return ret;
+}
+
+// Load the compile times of the previous builds
+static void internal_nom_times_load(InternalNomCompileState *state, const char *path) {
+    state->times.base.key = NOM_HASH_KEY_SV;
+    state->times_file = nom_map_file(path);
+    if(state->times_file.data == NULL) {
+        return;
+    }
+
+    NomSvSplit lines = nom_sv_split(state->times_file, '\n');
+    NomStringView line;
+    while(nom_sv_split_next(&lines, &line)) {
+        NomStringView ns_str = nom_sv_chop_by_delim(&line, ' ');
+        if(ns_str.len == 0 || line.len == 0) {
+            continue;
+        }
+        uint64_t ns = 0;
+        bool valid = true;
+        for(size_t i = 0; i < ns_str.len && valid; ++i) {
+            valid = ns_str.data[i] >= '0' && ns_str.data[i] <= '9';
+            ns = ns*10 + (ns_str.data[i] - '0');
+        }
+        if(valid) {
+            nom_hm_put(&state->times, line, ns);
+        }
+    }
+}
+
+// Save the compile times of this build, keeping the previous ones of the sources not compiled
+static bool internal_nom_times_save(InternalNomCompileState *state, const char *path) {
+    NomStringBuilder out = {0};
+    size_t stale = 0;
+    for(size_t i = 0; i < state->sources.len; ++i) {
+        const char *src_path = state->sources.items[i].src_path;
+        uint64_t ns = 0;
+        // Stale sources are in the same order as the sources
+        if(stale < state->stale.len && state->stale.items[stale].src_path == src_path) {
+            ns = state->job_ns[stale++];
+        }
+        if(ns == 0) {
+            uint64_t *old = nom_hm_get(&state->times, nom_sv_from_str(src_path));
+            ns = old ? *old : 0;
+        }
+        if(ns > 0) {
+            nom_sb_append_u64(&out, ns);
+            nom_sb_append_char(&out, ' ');
+            nom_sb_append_str(&out, src_path);
+            nom_sb_append_nl(&out);
+        }
+    }
+    bool ret = nom_update_file(path, nom_sb_to_sv(out));
+    nom_sb_free(&out);
+    return ret;
+}
+
+// Append a duration rounded to seconds, as 42s, 1m10s or 2h05m
+static void internal_nom_append_duration(NomStringBuilder *sb, uint64_t ns) {
+    uint64_t secs = (ns + 500000000)/1000000000;
+    if(secs < 60) {
+        nom_sb_appendf(sb, "%" PRIu64 "s", secs);
+    } else if(secs < 3600) {
+        nom_sb_appendf(sb, "%" PRIu64 "m%02" PRIu64 "s", secs/60, secs%60);
+    } else {
+        nom_sb_appendf(sb, "%" PRIu64 "h%02" PRIu64 "m", secs/3600, secs/60%60);
+    }
+}
+
+static void internal_nom_progress_start(InternalNomCompileState *state) {
+    InternalNomProgress *progress = &state->progress;
+    progress->enabled = true;
+    progress->tty = isatty(STDERR_FILENO);
+    progress->total = state->stale.len;
+    progress->start_ns = nom_time_ns();
+
+    struct winsize ws;
+    if(progress->tty && ioctl(STDERR_FILENO, TIOCGWINSZ, &ws) == 0) {
+        progress->columns = ws.ws_col;
+    }
+
+    // Compiler diagnostics written straight to the terminal would be mixed with the status line.
+    // The jobs share an unlinked file instead, appending to it, and so does the log if it goes to
+    // the terminal too.
+    if(progress->tty) {
+        progress->output = tmpfile();
+        if(progress->output == NULL || fcntl(fileno(progress->output), F_SETFL, O_APPEND) < 0) {
+            nom_log(NOM_WARNING, "could not capture compiler output: %s", strerror(errno));
+            if(progress->output) fclose(progress->output);
+            progress->output = NULL;
+        }
+    }
+    if(progress->output) {
+        setvbuf(progress->output, NULL, _IONBF, 0);
+        progress->log_stream = nom_log_get_stream();
+        if(progress->log_stream == NULL || progress->log_stream == stderr) {
+            nom_log_flush();
+            nom_log_set_stream(progress->output);
+            progress->log_captured = true;
+        }
+    }
+
+    progress->estimates_ns = nom_arena_alloc(&state->arena, state->stale.len*sizeof(uint64_t));
+    for(size_t i = 0; i < state->stale.len; ++i) {
+        uint64_t *ns = nom_hm_get(&state->times, nom_sv_from_str(state->stale.items[i].src_path));
+        progress->estimates_ns[i] = ns ? *ns : 0;
+        if(ns && *ns > 0) {
+            progress->known_left_ns += *ns;
+            progress->known_count++;
+        } else {
+            progress->unknown_left++;
+        }
+    }
+}
+
+// Show the jobs' output written since the last call, clearing the status line first
+static void internal_nom_progress_show_output(InternalNomProgress *progress) {
+    if(progress->output == NULL) {
+        return;
+    }
+
+    if(progress->log_captured) {
+        nom_log_flush();
+    }
+
+    char buf[4096];
+    ssize_t n;
+    while((n = pread(fileno(progress->output), buf, sizeof(buf), progress->output_shown)) > 0) {
+        if(progress->shown) {
+            fputs("\r\x1b[K", stderr);
+            progress->shown = false;
+        }
+        fwrite(buf, 1, n, stderr);
+        progress->output_shown += n;
+    }
+}
+
+// Account for a finished job (`id` 0 if it never started) and show the status line
+static void internal_nom_progress_update(InternalNomProgress *progress, size_t id, const char *src_path, uint64_t ns) {
+    if(!progress->enabled) {
+        return;
+    }
+
+    internal_nom_progress_show_output(progress);
+
+    progress->done++;
+    progress->actual_done_ns += ns;
+    uint64_t estimate = id > 0 ? progress->estimates_ns[id - 1] : 0;
+    if(estimate > 0) {
+        progress->known_done_ns += estimate;
+        progress->known_left_ns -= estimate;
+    } else {
+        progress->unknown_done++;
+        progress->unknown_left--;
+    }
+
+    // Time of an average job, from previous builds or else from this one
+    uint64_t average_ns = progress->known_count > 0
+        ? (progress->known_done_ns + progress->known_left_ns)/progress->known_count
+        : progress->actual_done_ns/progress->done;
+    uint64_t work_done_ns = progress->known_done_ns + progress->unknown_done*average_ns;
+    uint64_t work_left_ns = progress->known_left_ns + progress->unknown_left*average_ns;
+    uint64_t elapsed_ns = nom_time_ns() - progress->start_ns;
+
+    nom_sb_inline(line);
+    if(progress->tty) {
+        nom_sb_append_char(&line, '\r');
+    }
+    nom_sb_appendf(&line, "[%zu/%zu] ", progress->done, progress->total);
+    internal_nom_append_duration(&line, elapsed_ns);
+    nom_sb_append_str(&line, " ETA ");
+    if(work_done_ns > 0) {
+        internal_nom_append_duration(&line, (uint64_t) ((double) elapsed_ns*work_left_ns/work_done_ns));
+    } else {
+        nom_sb_append_char(&line, '?');
+    }
+    nom_sb_append_str(&line, "  ");
+
+    NomStringView path = nom_sv_from_str(src_path ? src_path : "");
+    if(progress->tty && progress->columns > 0) {
+        // Keep it on one line, cutting the path from the left
+        size_t used = line.len - 1;
+        size_t room = progress->columns > used + 4 ? progress->columns - used - 1 : 0;
+        if(path.len > room) {
+            nom_sb_append_str(&line, "...");
+            room = room > 3 ? room - 3 : 0;
+            path = nom_sv(path.data + path.len - room, room);
+        }
+    }
+    nom_sb_append_sv(&line, path);
+    nom_sb_append_str(&line, progress->tty ? "\x1b[K" : "\n");
+    fwrite(line.items, 1, line.len, stderr);
+    nom_sb_free(&line);
+    progress->shown = true;
+}
+
+// End the status line, so what follows starts on a new line
+static void internal_nom_progress_finish(InternalNomProgress *progress) {
+    internal_nom_progress_show_output(progress);
+    if(progress->tty && progress->shown) {
+        fputc('\n', stderr);
+    }
+    progress->shown = false;
+    if(progress->log_captured) {
+        nom_log_set_stream(progress->log_stream);
+        progress->log_captured = false;
+    }
+    if(progress->output) {
+        fclose(progress->output);
+        progress->output = NULL;
+    }
+}
+
+static void internal_nom_explain_add(InternalNomExplain *explain, const char *obj_path, NomRebuildReason reason, NomInternId cause) {
+    nom_rebuild_reason_log(obj_path, reason);
+    explain->causes[reason.cause]++;
+    if(reason.cause == NOM_REBUILD_DEP_MISSING || reason.cause == NOM_REBUILD_DEP_NEWER) {
+        if(explain->deps.len <= cause) {
+            nom_darr_resize(&explain->deps, cause + 1);
+        }
+        explain->deps.items[cause]++;
+    }
+}
+
+// Dependency that caused rebuilds, and how many
+typedef struct InternalNomExplainDep {
+    NomInternId id;
+    size_t rebuilds;
+} InternalNomExplainDep;
+
+NOM_DEFINE_CMP(internal_nom_explain_dep_cmp, InternalNomExplainDep, dep_a, dep_b) {
+    if(dep_a->rebuilds != dep_b->rebuilds) return dep_a->rebuilds > dep_b->rebuilds ? -1 : 1;
+    return (dep_a->id > dep_b->id) - (dep_a->id < dep_b->id);
+}
+
+// Max number of dependencies listed by the explain mode summary
+#define INTERNAL_NOM_EXPLAIN_TOP_DEPS 20
+
+// Log the rebuilds by cause, and the dependencies that caused the most
+static void internal_nom_explain_report(InternalNomCompileState *state) {
+    InternalNomExplain *explain = &state->explain;
+    nom_log(NOM_INFO, "explain: %zu of %zu sources rebuild: %zu %s, %zu %s, %zu %s, %zu %s",
+            state->stale.len, state->sources.len,
+            explain->causes[NOM_REBUILD_NO_OUTPUT], nom_rebuild_cause_str(NOM_REBUILD_NO_OUTPUT),
+            explain->causes[NOM_REBUILD_NO_DEPS_FILE], nom_rebuild_cause_str(NOM_REBUILD_NO_DEPS_FILE),
+            explain->causes[NOM_REBUILD_DEP_MISSING], nom_rebuild_cause_str(NOM_REBUILD_DEP_MISSING),
+            explain->causes[NOM_REBUILD_DEP_NEWER], nom_rebuild_cause_str(NOM_REBUILD_DEP_NEWER));
+
+    NomDarr(InternalNomExplainDep) deps = {0};
+    for(size_t i = 0; i < explain->deps.len; ++i) {
+        if(explain->deps.items[i] > 0) {
+            InternalNomExplainDep dep = { .id = i, .rebuilds = explain->deps.items[i] };
+            nom_darr_append(&deps, dep);
+        }
+    }
+    if(deps.len > 0) {
+        nom_darr_sort(&deps, internal_nom_explain_dep_cmp);
+        nom_log(NOM_INFO, "explain: dependencies by rebuilds caused:");
+        for(size_t i = 0; i < deps.len && i < INTERNAL_NOM_EXPLAIN_TOP_DEPS; ++i) {
+            nom_log(NOM_INFO, "explain: %8zu  %s", deps.items[i].rebuilds, nom_interner_str(&state->stat_cache.paths, deps.items[i].id));
+        }
+        if(deps.len > INTERNAL_NOM_EXPLAIN_TOP_DEPS) {
+            nom_log(NOM_INFO, "explain: ... and %zu more", deps.len - INTERNAL_NOM_EXPLAIN_TOP_DEPS);
+        }
+    }
+    nom_darr_free(&deps);
+}
+
+// Start the compile job of a source
+static void internal_nom_start_job(InternalNomSource source, size_t id, InternalNomCompileState *state) {
+    const NomCompileConfig *config = state->config;
+    uint64_t start_ns = nom_time_ns();
+
+    NomCmd cmd = state->cmd;
+    nom_cmd_append(&cmd, config->cc, "-c", "-MMD", "-o", source.obj_path);
+    nom_cmd_append_flags(&cmd, config->flags);
+    nom_cmd_append(&cmd, source.src_path);
+    cmd.err_fd = state->progress.output ? fileno(state->progress.output) : 0;
+    nom_log_set_job(id);
+    NomProc proc = nom_cmd_run_async(cmd);
+    nom_log_set_job(NOM_LOG_NO_JOB);
+    nom_cmd_reset(&cmd);
+    state->cmd = cmd;
+
+    nom_darr_append_arena(&state->arena, &state->procs, proc);
+    if(proc == NOM_INVALID_PROC) {
+        return;
+    }
+
+    InternalNomJob job = {
+        .src_path   = source.src_path,
+        .id         = id,
+        .start_ns   = start_ns,
+        .slot       = state->free_slots.len > 0 ? nom_darr_pop(&state->free_slots) : state->slots++,
+    };
+    nom_hm_put(&state->jobs, proc, job);
+}
+
+// Reap the compile jobs as they finish
+static bool internal_nom_wait_jobs(InternalNomCompileState *state) {
+    bool success = true;
+
+    NomProc proc;
+    bool ok;
+    NomProcUsage usage;
+    while(nom_procs_wait_any(&state->procs, &proc, &ok, &usage)) {
+        uint64_t end_ns = nom_time_ns();
+        success = success && ok;
+
+        InternalNomJob *found = nom_hm_get(&state->jobs, proc);
+        if(found == NULL) {
+            // It never started
+            internal_nom_progress_update(&state->progress, 0, NULL, 0);
+            continue;
+        }
+        InternalNomJob job = *found;
+        nom_hm_remove(&state->jobs, proc);
+
+        if(ok) {
+            state->job_ns[job.id - 1] = end_ns - job.start_ns;
+        } else {
+            if(state->progress.tty && !state->progress.log_captured) {
+                // Clear the status line
+                fputs("\r\x1b[K", stderr);
+            }
+            nom_log_set_job(job.id);
+            nom_log(NOM_ERROR, "could not compile `%s`", job.src_path);
+            nom_log_set_job(NOM_LOG_NO_JOB);
+        }
+        nom_trace_job(job.src_path, job.start_ns, end_ns, job.slot, proc);
+        nom_darr_append_arena(&state->arena, &state->free_slots, job.slot);
+        internal_nom_progress_update(&state->progress, job.id, job.src_path, end_ns - job.start_ns);
+
+        NomCompileJob finished = {
+            .src_path   = job.src_path,
+            .success    = ok,
+            .start_ns   = job.start_ns,
+            .end_ns     = end_ns,
+            .usage      = usage,
+        };
+        nom_darr_append_arena(&state->arena, &state->finished, finished);
+    }
+
+    return success;
+}
+
+#define INTERNAL_NOM_COMPILE_DB_PATH "compile_commands.json"
+
+// An entry of the compilation database as found in the file
+typedef struct InternalNomDbEntry {
+    NomStringView line; // Without indentation nor separating comma
+    size_t pos;         // Index of the entry in the file
+} InternalNomDbEntry;
+
+// Entries of the compilation database by (escaped) file path
+typedef NomHashMap(NomStringView, InternalNomDbEntry) InternalNomDbIndex;
+
+// Append a JSON string
+static void internal_nom_json_append_str(NomStringBuilder *out, NomStringView str) {
+    nom_sb_append_char(out, '"');
+    nom_sb_append_json_escaped(out, str);
+    nom_sb_append_char(out, '"');
+}
+
+// Render the compilation database entry of a source, in a single line. The arguments are the
+// ones internal_nom_start_job runs.
+static void internal_nom_db_render_entry(NomStringBuilder *out, const NomCompileConfig *config, const char *cwd, InternalNomSource source) {
+    NomStringView src = nom_sv_from_str(source.src_path);
+    NomStringView obj = nom_sv_from_str(source.obj_path);
+
+    nom_sb_append_str(out, "{\"directory\": ");
+    internal_nom_json_append_str(out, nom_sv_from_str(cwd));
+    nom_sb_append_str(out, ", \"file\": ");
+    internal_nom_json_append_str(out, src);
+    nom_sb_append_str(out, ", \"output\": ");
+    internal_nom_json_append_str(out, obj);
+
+    nom_sb_append_str(out, ", \"arguments\": [");
+    internal_nom_json_append_str(out, nom_sv_from_str(config->cc));
+    nom_sb_append_str(out, ", \"-c\", \"-MMD\", \"-o\", ");
+    internal_nom_json_append_str(out, obj);
+    for(size_t i = 0; i < config->flags.len; ++i) {
+        nom_sb_append_str(out, ", ");
+        internal_nom_json_append_str(out, nom_sv_from_str(config->flags.items[i]));
+    }
+    nom_sb_append_str(out, ", ");
+    internal_nom_json_append_str(out, src);
+    nom_sb_append_str(out, "]}");
+}
+
+// Get the (escaped) file path of an entry line, or a view with NULL data if it has none
+static NomStringView internal_nom_db_entry_key(NomStringView line) {
+    static const char field[] = "\"file\": \"";
+
+    size_t start = nom_sv_find(line, nom_sv(field, sizeof(field) - 1));
+    if(start == NOM_SV_NPOS) {
+        return nom_sv(NULL, 0);
+    }
+    start += sizeof(field) - 1;
+
+    for(size_t i = start; i < line.len; ++i) {
+        if(line.data[i] == '\\') {
+            // Escaped char
+            i++;
+        } else if(line.data[i] == '"') {
+            return nom_sv(line.data + start, i - start);
+        }
+    }
+    return nom_sv(NULL, 0);
+}
+
+// Index the entries of a compilation database written by internal_nom_db_update, one per line.
+// Anything else (ex: a database in another format) is ignored, so its entries are all rewritten.
+static void internal_nom_db_index(NomStringView db, InternalNomDbIndex *index) {
+    NomSvSplit lines = nom_sv_split(db, '\n');
+    NomStringView line;
+    size_t pos = 0;
+    while(nom_sv_split_next(&lines, &line)) {
+        line = nom_sv_trim(line);
+        if(nom_sv_ends_with(line, nom_sv_from_str(","))) {
+            line.len--;
+        }
+        if(!nom_sv_starts_with(line, nom_sv_from_str("{"))) {
+            continue;
+        }
+
+        NomStringView key = internal_nom_db_entry_key(line);
+        if(key.data == NULL) {
+            continue;
+        }
+        InternalNomDbEntry entry = {
+            .line = line,
+            .pos = pos++,
+        };
+        nom_hm_put(index, key, entry);
+    }
+}
+
+// Bring the compilation database in line with `sources`. Only the entries of sources that were
+// added or whose command changed are rendered again; the rest are copied from the current file,
+// and it is left untouched if nothing changed.
+static bool internal_nom_db_update(NomArena *arena, const NomCompileConfig *config, InternalNomSources sources) {
+    bool ret = true;
+
+    char *cwd = nom_get_cwd();
+    if(!cwd) return false;
+
+    NomStringView old = nom_map_file(INTERNAL_NOM_COMPILE_DB_PATH);
+    if(old.data == NULL && errno != ENOENT) {
+        NOM_FREE(cwd);
+        return false;
+    }
+
+    InternalNomDbIndex index = {.base.key = NOM_HASH_KEY_SV};
+    if(old.data != NULL) {
+        internal_nom_db_index(old, &index);
+    }
+
+    // Diff the sources against the index. New lines are only kept for entries that changed.
+    NomArenaMark mark = nom_arena_mark(arena);
+    NomStringView *lines = nom_arena_alloc(arena, (sources.len + 1)*sizeof(*lines));
+    size_t added = 0;
+    size_t changed = 0;
+    size_t kept = 0;
+    bool in_order = true;
+    nom_sb_inline(line);
+    for(size_t i = 0; i < sources.len; ++i) {
+        nom_sb_reset(&line);
+        internal_nom_db_render_entry(&line, config, cwd, sources.items[i]);
+        NomStringView new_line = nom_sb_to_sv(line);
+
+        InternalNomDbEntry *entry = nom_hm_get(&index, internal_nom_db_entry_key(new_line));
+        if(entry != NULL && nom_sv_eq(entry->line, new_line)) {
+            lines[i] = entry->line;
+            in_order = in_order && entry->pos == i;
+            kept++;
+        } else {
+            lines[i] = nom_sv(nom_arena_strndup(arena, new_line.data, new_line.len), new_line.len);
+            if(entry == NULL) {
+                added++;
+            } else {
+                changed++;
+            }
+        }
+    }
+    nom_sb_free(&line);
+    size_t removed = nom_hm_len(&index) - kept - changed;
+
+    if(old.data != NULL && added == 0 && changed == 0 && removed == 0 && in_order) {
+        nom_log(NOM_INFO, "file `%s` is up to date", INTERNAL_NOM_COMPILE_DB_PATH);
+        nom_return_defer(true);
+    }
+
+    // Merge
+    NomFileWriter out;
+    if(!nom_file_writer_open(&out, INTERNAL_NOM_COMPILE_DB_PATH)) nom_return_defer(false);
+    nom_sb_append_str(&out.buf, "[\n");
+    for(size_t i = 0; i < sources.len; ++i) {
+        nom_sb_append_str(&out.buf, i == 0 ? "    " : ",\n    ");
+        nom_sb_append_sv(&out.buf, lines[i]);
+        nom_file_writer_flush(&out);
+    }
+    nom_sb_append_str(&out.buf, sources.len == 0 ? "]\n" : "\n]\n");
+    if(!nom_file_writer_close(&out)) nom_return_defer(false);
+
+    nom_log(NOM_INFO, "compilation database has %zu entries (%zu added, %zu changed, %zu removed)", sources.len, added, changed, removed);
+
+defer:
+    nom_arena_rewind(arena, mark);
+    nom_hm_free(&index);
+    nom_unmap_file(old);
+    NOM_FREE(cwd);
+    return ret;
+}
+
 bool nom_compile(const NomCompileConfig *config) {
     bool ret = true;
-    const char *obj;
 
-    InternalNomCompileFileState state = {
+    if(config->stats) {
+        nom_stats_reset();
+    }
+    uint64_t start_ns = config->stats ? nom_time_ns() : 0;
+
+    InternalNomCompileState state = {
         .config     = config,
+        .arena      = {0},
         .cmd        = {0},
         .procs      = {0},
+        .sources    = {0},
+        .stale      = {0},
         .objs       = {0},
     };
 
     if(!nom_mkdir(config->obj_dir)) nom_return_defer(false);
 
-    if(!nom_files_walk_tree(config->src_dir, internal_nom_walkable_compile_file, &state)) nom_return_defer(false);
-    if(!nom_procs_wait(state.procs)) nom_return_defer(false);
+    // Collect sources, and create the directories for their objects up front
+    NomTraceSpan span = nom_trace_begin("walk source tree");
+    bool ok = nom_files_walk_tree(config->src_dir, internal_nom_walkable_collect_source, &state);
+    nom_darr_sort(&state.sources, internal_nom_source_cmp);
+    nom_trace_end(span);
+    if(!ok) nom_return_defer(false);
+
+    span = nom_trace_begin("create object directories");
+    ok = internal_nom_create_obj_dirs(config, state.sources);
+    nom_trace_end(span);
+    if(!ok) nom_return_defer(false);
+
+    if(config->update_compile_db) {
+        span = nom_trace_begin("update compilation database");
+        ok = internal_nom_db_update(&state.arena, config, state.sources);
+        nom_trace_end(span);
+        if(!ok) nom_return_defer(false);
+    }
+
+    // From here on each bundle stands for its members. The database above keeps the sources.
+    if(config->unity_size > 1) {
+        span = nom_trace_begin("write unity bundles");
+        ok = internal_nom_unity_bundle(&state);
+        nom_trace_end(span);
+        if(!ok) nom_return_defer(false);
+    }
+
+    // Every source contributes one object, and at most one compile job
+    nom_darr_reserve_arena(&state.arena, &state.objs, state.sources.len);
+
+    span = nom_trace_begin("check dependencies");
+    for(size_t i = 0; i < state.sources.len; ++i) {
+        InternalNomSource source = state.sources.items[i];
+        nom_darr_append_arena(&state.arena, &state.objs, source.obj_path);
+        NomRebuildReason reason;
+        NomInternId cause = 0;
+        if(internal_nom_src_needs_rebuild(&state.arena, &state.stat_cache, source.obj_path, config->explain ? &reason : NULL, &cause)) {
+            nom_darr_append_arena(&state.arena, &state.stale, source);
+            if(config->explain) {
+                internal_nom_explain_add(&state.explain, source.obj_path, reason, cause);
+            }
+        }
+    }
+    if(config->explain) {
+        internal_nom_explain_report(&state);
+    }
+    nom_trace_end(span);
+    NOM_STAT_ADD(sources_scanned, state.sources.len);
+    NOM_STAT_ADD(sources_compiled, state.stale.len);
+    NOM_STAT_ADD(sources_up_to_date, state.sources.len - state.stale.len);
+
+    span = nom_trace_begin("compile");
+    const char *times_path = NULL;
+    if(state.stale.len > 0) {
+        state.job_ns = nom_arena_alloc(&state.arena, state.stale.len*sizeof(uint64_t));
+        memset(state.job_ns, 0, state.stale.len*sizeof(uint64_t));
+    }
+    // The compile times history only feeds the ETA of the progress line
+    if(config->progress && state.stale.len > 0) {
+        NomStringBuilder path = {0};
+        nom_sb_append_str_arena(&state.arena, &path, config->obj_dir);
+        nom_sb_append_str_arena(&state.arena, &path, "/" INTERNAL_NOM_COMPILE_TIMES_FILE);
+        nom_sb_append_null_arena(&state.arena, &path);
+        times_path = path.items;
+        internal_nom_times_load(&state, times_path);
+    }
+
+    // The progress line replaces the command lines
+    NomLogLevel log_level = nom_log_get_level();
+    if(config->progress && state.stale.len > 0) {
+        internal_nom_progress_start(&state);
+        if(log_level < NOM_WARNING) nom_log_set_level(NOM_WARNING);
+    }
+
+    nom_darr_reserve_arena(&state.arena, &state.procs, state.stale.len);
+    for(size_t i = 0; i < state.stale.len; ++i) {
+        internal_nom_start_job(state.stale.items[i], i + 1, &state);
+    }
+    ok = internal_nom_wait_jobs(&state);
+    internal_nom_progress_finish(&state.progress);
+    if(times_path) {
+        ok = internal_nom_times_save(&state, times_path) && ok;
+    }
+    nom_log_set_level(log_level);
+    nom_trace_end(span);
+    if(config->report_top_jobs > 0) {
+        nom_compile_jobs_report(state.finished, config->report_top_jobs);
+    }
+    if(config->jobs) {
+        for(size_t i = 0; i < state.finished.len; ++i) {
+            NomCompileJob job = state.finished.items[i];
+            size_t len = strlen(job.src_path);
+            char *src_path = NOM_MALLOC(len + 1);
+            NOM_ASSERT(src_path != NULL && "malloc failed");
+            memcpy(src_path, job.src_path, len + 1);
+            job.src_path = src_path;
+            nom_darr_append(config->jobs, job);
+        }
+    }
+    if(!ok) nom_return_defer(false);
 
     // Only link if any object file changed (or executable doesn't exist)
-    if(nom_needs_rebuild(config->target, state.objs.items, state.objs.len)) {
+    span = nom_trace_begin("link");
+    NomRebuildReason link_reason;
+    if(nom_needs_rebuild_explain(config->target, state.objs.items, state.objs.len, config->explain ? &link_reason : NULL)) {
+        if(config->explain) {
+            nom_rebuild_reason_log(config->target, link_reason);
+        }
         NomCmd link_cmd = state.cmd;
+        nom_darr_reserve(&link_cmd, 3 + config->flags.len + state.objs.len);
         nom_cmd_append(&link_cmd, config->cc, "-o", config->target);
         nom_cmd_append_flags(&link_cmd, config->flags);
         nom_cmd_append_buf(&link_cmd, state.objs.items, state.objs.len);
-        if(!nom_cmd_run_sync(link_cmd)) nom_return_defer(false);
+        ok = nom_cmd_run_sync(link_cmd);
         nom_cmd_reset(&link_cmd);
         state.cmd = link_cmd;
     }
+    nom_trace_end(span);
+    if(!ok) nom_return_defer(false);
 
 defer:
-    // Free Compile File State
+    // Free Compile State
     nom_cmd_free(&state.cmd);
-    nom_darr_free(&state.procs);
-    nom_darr_foreach(obj, state.objs) {
-        NOM_FREE_CONST(obj);
+    nom_hm_free(&state.jobs);
+    nom_hm_free(&state.times);
+    nom_darr_free(&state.explain.deps);
+    nom_unmap_file(state.times_file);
+    internal_nom_stat_cache_free(&state.stat_cache);
+    nom_arena_free(&state.arena);
+
+    if(config->stats) {
+        nom_stats_report(nom_time_ns() - start_ns);
     }
-    nom_darr_free(&state.objs);
-
     return ret;
 }
 
-static void internal_nom_build_compile_object(const char *path, NomFileType type, NomFileStats *ftw, const NomCompileConfig *config, const char *cwd, NomStringBuilder *out) {
-    #define INDENT "    "
-
-    if(type != NOM_FILE_REG || strcmp(path + ftw->path_len - 2, ".c") != 0) {
-        // Only process '.c' files
-        return;
-    }
-
-    // Open
-    nom_sb_append_str(out, INDENT "{\n");
-
-    // Directory
-    nom_sb_append_str(out, INDENT INDENT "\"directory\": \"");
-    nom_sb_append_str(out, cwd);
-    nom_sb_append_str(out, "\",\n");
+NOM_DEFINE_CMP(internal_nom_job_cpu_cmp, NomCompileJob, job_a, job_b) {
+    uint64_t cpu_a = job_a->usage.user_ns + job_a->usage.sys_ns;
+    uint64_t cpu_b = job_b->usage.user_ns + job_b->usage.sys_ns;
+    return (cpu_a < cpu_b) - (cpu_a > cpu_b);
+}
 
-    // File
-    nom_sb_append_str(out, INDENT INDENT "\"file\": \"");
-    nom_sb_append_str(out, path);
-    nom_sb_append_str(out, "\",\n");
+NOM_DEFINE_CMP(internal_nom_job_rss_cmp, NomCompileJob, job_a, job_b) {
+    return (job_a->usage.max_rss_kb < job_b->usage.max_rss_kb) - (job_a->usage.max_rss_kb > job_b->usage.max_rss_kb);
+}
 
-    // Arguments
-    nom_sb_append_str(out, INDENT INDENT "\"arguments\": [\"");
+// Job start (+rss) or end (-rss)
+typedef struct InternalNomJobEvent {
+    uint64_t ns;
+    int64_t rss_kb;
+} InternalNomJobEvent;
 
-    nom_sb_append_str(out, config->cc);
-    nom_sb_append_str(out, "\", \"-c\", \"-o\", \"");
-    nom_sb_append_str(out, config->obj_dir);
-    nom_sb_append_str(out, path + ftw->base_root);
-    out->len -= 2;
-    nom_sb_append_str(out, ".o\", ");
+// Ends sort before starts at the same time, as those jobs didn't overlap
+NOM_DEFINE_CMP(internal_nom_job_event_cmp, InternalNomJobEvent, event_a, event_b) {
+    if(event_a->ns != event_b->ns) return event_a->ns < event_b->ns ? -1 : 1;
+    return (event_a->rss_kb > event_b->rss_kb) - (event_a->rss_kb < event_b->rss_kb);
+}
 
-    NomCmdFlags flags = config->flags;
-    const char *arg;
-    nom_darr_foreach(arg, flags) {
-        nom_sb_append_char(out, '"');
-        nom_sb_append_str(out, arg);
-        nom_sb_append_str(out, "\", ");
+void nom_compile_jobs_report(NomCompileJobs jobs, size_t top) {
+    if(jobs.len == 0) {
+        return;
+    }
+    if(top > jobs.len) {
+        top = jobs.len;
     }
 
-    nom_sb_append_char(out, '"');
-    nom_sb_append_str(out, path);
-    nom_sb_append_str(out, "\"]\n");
-
-    // Close
-    nom_sb_append_str(out, INDENT "},\n");
+    NomCompileJobs sorted = {0};
+    nom_darr_append_many(&sorted, jobs.items, jobs.len);
+
+    nom_darr_sort(&sorted, internal_nom_job_cpu_cmp);
+    nom_log(NOM_INFO, "compile jobs with the most CPU time:");
+    for(size_t i = 0; i < top; ++i) {
+        NomCompileJob job = sorted.items[i];
+        nom_log(NOM_INFO, "  %8.2fs (user %.2fs, sys %.2fs, %zu context switches)  %s",
+                (double) (job.usage.user_ns + job.usage.sys_ns)/1e9, (double) job.usage.user_ns/1e9,
+                (double) job.usage.sys_ns/1e9, job.usage.voluntary_switches + job.usage.involuntary_switches,
+                job.src_path);
+    }
 
-    #undef INDENT
+    nom_darr_sort(&sorted, internal_nom_job_rss_cmp);
+    nom_log(NOM_INFO, "compile jobs with the most memory:");
+    for(size_t i = 0; i < top; ++i) {
+        NomCompileJob job = sorted.items[i];
+        nom_log(NOM_INFO, "  %8.1fMB (%zu minor, %zu major page faults)  %s",
+                (double) job.usage.max_rss_kb/1024, job.usage.minor_faults, job.usage.major_faults, job.src_path);
+    }
+    nom_darr_free(&sorted);
+
+    // Upper bound of the memory used at once: sum of the peaks of the jobs running at the same time
+    NomDarr(InternalNomJobEvent) events = {0};
+    nom_darr_reserve(&events, 2*jobs.len);
+    for(size_t i = 0; i < jobs.len; ++i) {
+        NomCompileJob job = jobs.items[i];
+        InternalNomJobEvent start = { .ns = job.start_ns, .rss_kb = (int64_t) job.usage.max_rss_kb };
+        InternalNomJobEvent end = { .ns = job.end_ns, .rss_kb = -(int64_t) job.usage.max_rss_kb };
+        nom_darr_append(&events, start);
+        nom_darr_append(&events, end);
+    }
+    nom_darr_sort(&events, internal_nom_job_event_cmp);
+    int64_t rss_kb = 0;
+    int64_t peak_rss_kb = 0;
+    for(size_t i = 0; i < events.len; ++i) {
+        rss_kb += events.items[i].rss_kb;
+        if(rss_kb > peak_rss_kb) peak_rss_kb = rss_kb;
+    }
+    nom_darr_free(&events);
+    nom_log(NOM_INFO, "peak memory of concurrent compile jobs: up to %.1fMB", (double) peak_rss_kb/1024);
 }
 
-static bool internal_nom_walkable_build_compile_object(const char *path, NomFileType type, NomFileStats *ftw, va_list args) {
-    const NomCompileConfig *config = va_arg(args, NomCompileConfig *);
-    const char *cwd = va_arg(args, const char *);
-    NomStringBuilder *out = va_arg(args, NomStringBuilder *);
-
-    internal_nom_build_compile_object(path, type, ftw, config, cwd, out);
-
-    return true;
+void nom_compile_jobs_free(NomCompileJobs *jobs) {
+    for(size_t i = 0; i < jobs->len; ++i) {
+        NOM_FREE_CONST(jobs->items[i].src_path);
+    }
+    nom_darr_free(jobs);
 }
 
 bool nom_build_compilation_database(const NomCompileConfig *config) {
-    const char *src_dir = config->src_dir;
-    NOM_ASSERT(*src_dir != '/' && "we don't support absolute paths for now");
+    NOM_ASSERT(*config->src_dir != '/' && "we don't support absolute paths for now");
 
-    char *cwd = nom_get_cwd();
-    if(!cwd) return false;
+    bool ret = true;
 
-    NomStringBuilder compile_db_sb = {0};
-    nom_sb_append_str(&compile_db_sb, "[\n");
-    nom_files_walk_tree(src_dir, internal_nom_walkable_build_compile_object, config, cwd, &compile_db_sb);
-    compile_db_sb.len -= 2; // Delete trailing comma
-    nom_sb_append_str(&compile_db_sb, "\n]\n");
-    bool ret = nom_write_file("compile_commands.json", nom_sb_to_sv(compile_db_sb));
+    InternalNomCompileState state = {
+        .config     = config,
+        .arena      = {0},
+        .sources    = {0},
+    };
 
-    nom_sb_free(&compile_db_sb);
-    NOM_FREE(cwd);
+    NomTraceSpan span = nom_trace_begin("walk source tree");
+    bool ok = nom_files_walk_tree(config->src_dir, internal_nom_walkable_collect_source, &state);
+    nom_darr_sort(&state.sources, internal_nom_source_cmp);
+    nom_trace_end(span);
+    if(!ok) nom_return_defer(false);
+
+    span = nom_trace_begin("update compilation database");
+    ret = internal_nom_db_update(&state.arena, config, state.sources);
+    nom_trace_end(span);
+
+defer:
+    nom_arena_free(&state.arena);
     return ret;
 }
 
 bool nom_clean(const NomCompileConfig *compile_config) {
     bool ret = true;
-    ret &= nom_delete(compile_config->obj_dir);
+    if(compile_config->background_clean) {
+        ret &= nom_delete_dir_async(compile_config->obj_dir);
+    } else {
+        ret &= nom_delete(compile_config->obj_dir);
+    }
     ret &= nom_delete(compile_config->target);
     return ret;
 }
@@ -1,16 +1,64 @@
 #ifndef NOM_COMPILE_H
 #define NOM_COMPILE_H
 
+#include <time.h>
+
+// A compile job run by nom_compile, and the resources it used
+typedef struct NomCompileJob {
+    const char *src_path;
+    bool success;
+    uint64_t start_ns;
+    uint64_t end_ns;
+    NomProcUsage usage;
+} NomCompileJob;
+
+typedef NomDarr(NomCompileJob) NomCompileJobs;
+
 typedef struct NomCompileConfig {
     const char *cc;
     const char *target;
     const char *src_dir;
     const char *obj_dir;
     NomCmdFlags flags;
+    bool background_clean;  // Delete obj_dir in a background process on nom_clean
+    bool update_compile_db; // Keep compile_commands.json in sync with the sources on every nom_compile
+    bool stats;             // Log a report of timings and counters at the end of nom_compile
+    bool progress;          // Show a [n/N] status line with an ETA instead of the compile commands
+    bool explain;           // Log why each target is rebuilt, and which dependencies caused the most rebuilds
+    size_t report_top_jobs; // Log the N compile jobs that used the most CPU time and memory
+    NomCompileJobs *jobs;   // If set, the compile jobs run are appended to it. Free with nom_compile_jobs_free.
+    size_t unity_size;      // Compile the sources of each directory in bundles of up to N, 0 or 1 to disable
+    NomCmdFlags unity_exclude; // Sources, as found under src_dir, always compiled on their own in unity mode
 } NomCompileConfig;
 
+// Why a target needs to be rebuilt
+typedef enum {
+    NOM_REBUILD_NONE = 0,       // Up to date
+    NOM_REBUILD_NO_OUTPUT,      // The target doesn't exist
+    NOM_REBUILD_NO_DEPS_FILE,   // The deps file listing the dependencies of the target doesn't exist
+    NOM_REBUILD_DEP_MISSING,    // A dependency can't be stat'ed
+    NOM_REBUILD_DEP_NEWER,      // A dependency was modified after the target
+    NOM_REBUILD_CAUSES_COUNT,
+} NomRebuildCause;
+
+typedef struct NomRebuildReason {
+    NomRebuildCause cause;
+    const char *dependency;     // The missing or the newest dependency
+    time_t target_mtime;
+    time_t dependency_mtime;
+    size_t newer_count;         // Number of dependencies newer than the target
+} NomRebuildReason;
+
 bool nom_needs_rebuild(const char *target_path, const char * const dependencies[], size_t dependencies_count);
 
+// Same as nom_needs_rebuild, and tell why. All the dependencies are checked, to find the newest.
+bool nom_needs_rebuild_explain(const char *target_path, const char * const dependencies[], size_t dependencies_count, NomRebuildReason *reason);
+
+const char *nom_rebuild_cause_str(NomRebuildCause cause);
+
+// Log the reason a target is rebuilt
+void nom_rebuild_reason_log(const char *target_path, NomRebuildReason reason);
+
 //   How to use it:
 //     int main(int argc, const char** argv) {
 //         nom_rebuild_yourself(argc, argv, __FILE__);
@@ -30,6 +78,12 @@ void nom_rebuild_yourself(int argc, const char **argv, const char *src_path);
 
 bool nom_compile(const NomCompileConfig *config);
 
+// Log the `top` jobs that used the most CPU time and the most memory, and the peak memory
+// of the jobs that ran at the same time
+void nom_compile_jobs_report(NomCompileJobs jobs, size_t top);
+
+void nom_compile_jobs_free(NomCompileJobs *jobs);
+
 bool nom_build_compilation_database(const NomCompileConfig *config);
 
 bool nom_clean(const NomCompileConfig *compile_config);
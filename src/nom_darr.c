@@ -0,0 +1,39 @@
+#ifndef NOM_DARR_C
+#define NOM_DARR_C
+
+#include "nom_darr.h"
+
+size_t internal_nom_darr_grow_cap(size_t cap, size_t len, size_t n, size_t item_size) {
+    NOM_ASSERT(n <= SIZE_MAX - len && "dynamic array length overflow");
+    size_t min_cap = len + n;
+
+    size_t new_cap = cap == 0 ? NOM_DARR_INIT_CAP : cap;
+    while(new_cap < min_cap) {
+        // Double while it can, then settle for the exact size
+        new_cap = new_cap <= SIZE_MAX/2 ? new_cap*2 : min_cap;
+    }
+    NOM_ASSERT(new_cap <= SIZE_MAX/item_size && "dynamic array size overflow");
+
+    return new_cap;
+}
+
+void *internal_nom_darr_grow(void *items, size_t *cap, size_t len, size_t n, size_t item_size) {
+    size_t new_cap = internal_nom_darr_grow_cap(*cap, len, n, item_size);
+
+    void *tmp = NOM_REALLOC(items, new_cap*item_size);
+    NOM_ASSERT(tmp != NULL && "realloc failed");
+
+    *cap = new_cap;
+    return tmp;
+}
+
+void *internal_nom_darr_grow_arena(NomArena *arena, void *items, size_t *cap, size_t len, size_t n, size_t item_size) {
+    size_t new_cap = internal_nom_darr_grow_cap(*cap, len, n, item_size);
+
+    void *tmp = nom_arena_realloc(arena, items, *cap*item_size, new_cap*item_size);
+
+    *cap = new_cap;
+    return tmp;
+}
+
+#endif //NOM_DARR_C
@@ -2,7 +2,9 @@
 #define NOM_DARR_H
 
 #include "nom_defs.h"
+#include "nom_arena.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 // Initial capacity of a dynamic array
@@ -17,16 +19,30 @@
 typedef NomDarr(char *) NomStrDarr;
 typedef NomDarr(const char *) NomConstStrDarr;
 
+// Capacity needed to hold `n` items more than `len`, growing `cap` geometrically.
+// Asserts if the new size of the array in bytes doesn't fit in a size_t.
+size_t internal_nom_darr_grow_cap(size_t cap, size_t len, size_t n, size_t item_size);
+
+// Grow `items` so it has room for `n` more items, updating `cap`. Returns the new items.
+void *internal_nom_darr_grow(void *items, size_t *cap, size_t len, size_t n, size_t item_size);
+
+// Same as internal_nom_darr_grow, but the items are allocated from `arena`
+void *internal_nom_darr_grow_arena(NomArena *arena, void *items, size_t *cap, size_t len, size_t n, size_t item_size);
+
+// Make sure the dynamic array has room for at least `n` more items
+#define nom_darr_reserve(darr, n)                                                                   \
+    do {                                                                                            \
+        size_t internal_nom_reserve_n = (n);                                                        \
+        if ((darr)->cap - (darr)->len < internal_nom_reserve_n) {                                   \
+            (darr)->items = internal_nom_darr_grow((darr)->items, &(darr)->cap, (darr)->len,        \
+                    internal_nom_reserve_n, sizeof(*(darr)->items));                                \
+        }                                                                                           \
+    } while (0)
+
 // Append an item to a dynamic array
 #define nom_darr_append(darr, item)                                                                 \
     do {                                                                                            \
-        if ((darr)->len >= (darr)->cap) {                                                           \
-            (darr)->cap = (darr)->cap == 0 ? NOM_DARR_INIT_CAP : (darr)->cap*2;                     \
-            void *tmp = NOM_REALLOC((darr)->items, (darr)->cap*sizeof(*(darr)->items));             \
-            NOM_ASSERT(tmp != NULL && "realloc failed");                                            \
-            (darr)->items = tmp;                                                                    \
-        }                                                                                           \
-                                                                                                    \
+        nom_darr_reserve(darr, 1);                                                                  \
         (darr)->items[(darr)->len++] = (item);                                                      \
     } while (0)
 
@@ -45,26 +61,121 @@ typedef NomDarr(const char *) NomConstStrDarr;
     } while(0)
 
 // Append several items to dynamic array
-#define nom_darr_append_many(darr, new_items, new_items_len)                                    \
-    do {                                                                                        \
-        if ((darr)->len + new_items_len > (darr)->cap) {                                        \
-            if ((darr)->cap == 0) {                                                             \
-                (darr)->cap = NOM_DARR_INIT_CAP;                                                \
-            }                                                                                   \
-            while ((darr)->len + new_items_len > (darr)->cap) {                                 \
-                (darr)->cap *= 2;                                                               \
-            }                                                                                   \
-            void *tmp = NOM_REALLOC((darr)->items, (darr)->cap*sizeof(*(darr)->items));         \
-            NOM_ASSERT(tmp != NULL && "realloc failed");                                        \
-           (darr)->items = tmp;                                                                 \
-        }                                                                                       \
-        memcpy((darr)->items + (darr)->len, new_items, new_items_len*sizeof(*(darr)->items));   \
-        (darr)->len += new_items_len;                                                           \
+#define nom_darr_append_many(darr, new_items, new_items_len)                                        \
+    do {                                                                                            \
+        size_t internal_nom_many_len = (new_items_len);                                             \
+        if (internal_nom_many_len > 0) {                                                            \
+            nom_darr_reserve(darr, internal_nom_many_len);                                          \
+            memcpy((darr)->items + (darr)->len, (new_items), internal_nom_many_len*sizeof(*(darr)->items)); \
+            (darr)->len += internal_nom_many_len;                                                   \
+        }                                                                                           \
+    } while (0)
+
+// Set the length of the dynamic array. New items are zeroed.
+#define nom_darr_resize(darr, new_len)                                                              \
+    do {                                                                                            \
+        size_t internal_nom_new_len = (new_len);                                                    \
+        if (internal_nom_new_len > (darr)->len) {                                                   \
+            nom_darr_reserve(darr, internal_nom_new_len - (darr)->len);                             \
+            memset((darr)->items + (darr)->len, 0, (internal_nom_new_len - (darr)->len)*sizeof(*(darr)->items)); \
+        }                                                                                           \
+        (darr)->len = internal_nom_new_len;                                                         \
+    } while (0)
+
+// Release the unused capacity of the dynamic array
+#define nom_darr_shrink_to_fit(darr)                                                                \
+    do {                                                                                            \
+        if ((darr)->len == 0) {                                                                     \
+            nom_darr_free(darr);                                                                    \
+        } else if ((darr)->len < (darr)->cap) {                                                     \
+            void *internal_nom_tmp = NOM_REALLOC((darr)->items, (darr)->len*sizeof(*(darr)->items)); \
+            NOM_ASSERT(internal_nom_tmp != NULL && "realloc failed");                               \
+            (darr)->items = internal_nom_tmp;                                                       \
+            (darr)->cap = (darr)->len;                                                              \
+        }                                                                                           \
+    } while (0)
+
+// Insert an item at index `idx`, shifting the following items one place
+#define nom_darr_insert(darr, idx, item)                                                            \
+    do {                                                                                            \
+        size_t internal_nom_idx = (idx);                                                            \
+        NOM_ASSERT(internal_nom_idx <= (darr)->len && "index out of bounds");                       \
+        nom_darr_reserve(darr, 1);                                                                  \
+        memmove((darr)->items + internal_nom_idx + 1, (darr)->items + internal_nom_idx,             \
+                ((darr)->len - internal_nom_idx)*sizeof(*(darr)->items));                          \
+        (darr)->items[internal_nom_idx] = (item);                                                   \
+        (darr)->len++;                                                                              \
+    } while (0)
+
+// Remove the item at index `idx` in O(1), moving the last item into its place. Doesn't keep order.
+#define nom_darr_swap_remove(darr, idx)                                                             \
+    do {                                                                                            \
+        size_t internal_nom_idx = (idx);                                                            \
+        NOM_ASSERT(internal_nom_idx < (darr)->len && "index out of bounds");                        \
+        (darr)->items[internal_nom_idx] = (darr)->items[--(darr)->len];                             \
+    } while (0)
+
+// Remove and return the last item. The array must not be empty.
+#define nom_darr_pop(darr) (NOM_ASSERT((darr)->len > 0 && "pop from empty array"), (darr)->items[--(darr)->len])
+
+// Last item of the array. The array must not be empty.
+#define nom_darr_last(darr) ((darr)->items[(darr)->len - 1])
+
+// Define a qsort/bsearch comparator `name` where `a` and `b` are `const type *`. Follow it with the body:
+//  NOM_DEFINE_CMP(cmp_ints, int, a, b) { return (*a > *b) - (*a < *b); }
+#define NOM_DEFINE_CMP(name, type, a, b)                                                            \
+    static int internal_nom_typed_##name(const type *a, const type *b);                             \
+    static int name(const void *internal_nom_a, const void *internal_nom_b) {                       \
+        return internal_nom_typed_##name(internal_nom_a, internal_nom_b);                           \
+    }                                                                                               \
+    static int internal_nom_typed_##name(const type *a, const type *b)
+
+// Sort the dynamic array with a comparator, usually declared with NOM_DEFINE_CMP
+#define nom_darr_sort(darr, cmp)                                                                    \
+    do {                                                                                            \
+        if ((darr)->len > 1) {                                                                      \
+            qsort((darr)->items, (darr)->len, sizeof(*(darr)->items), (cmp));                       \
+        }                                                                                           \
+    } while (0)
+
+// Find `key` (a pointer to an item) in a dynamic array sorted by `cmp`. Returns a pointer to the item or NULL.
+#define nom_darr_bsearch(darr, key, cmp) \
+    ((darr)->len > 0 ? bsearch((key), (darr)->items, (darr)->len, sizeof(*(darr)->items), (cmp)) : NULL)
+
+// Make sure a dynamic array allocated from an arena has room for at least `n` more items
+#define nom_darr_reserve_arena(arena, darr, n)                                                      \
+    do {                                                                                            \
+        size_t internal_nom_reserve_n = (n);                                                        \
+        if ((darr)->cap - (darr)->len < internal_nom_reserve_n) {                                   \
+            (darr)->items = internal_nom_darr_grow_arena((arena), (darr)->items, &(darr)->cap,      \
+                    (darr)->len, internal_nom_reserve_n, sizeof(*(darr)->items));                   \
+        }                                                                                           \
+    } while (0)
+
+// Append an item to a dynamic array allocated from an arena. It must not be freed with nom_darr_free.
+#define nom_darr_append_arena(arena, darr, item)                                                    \
+    do {                                                                                            \
+        nom_darr_reserve_arena(arena, darr, 1);                                                     \
+        (darr)->items[(darr)->len++] = (item);                                                      \
+    } while (0)
+
+// Append several items to a dynamic array allocated from an arena. It must not be freed with nom_darr_free.
+#define nom_darr_append_many_arena(arena, darr, new_items, new_items_len)                           \
+    do {                                                                                            \
+        size_t internal_nom_many_len = (new_items_len);                                             \
+        if (internal_nom_many_len > 0) {                                                            \
+            nom_darr_reserve_arena(arena, darr, internal_nom_many_len);                             \
+            memcpy((darr)->items + (darr)->len, (new_items), internal_nom_many_len*sizeof(*(darr)->items)); \
+            (darr)->len += internal_nom_many_len;                                                   \
+        }                                                                                           \
     } while (0)
 
 // Iterate dynamic array
 #define nom_darr_foreach(iter, darr)                                    \
-    if((darr).len > 0) iter = (darr).items[0];                          \
-    for(size_t i = 0; i < (darr).len; i += 1, iter = (darr).items[i])
+    for(size_t i = 0; i < (darr).len && ((iter) = (darr).items[i], 1); i += 1)
 
 #endif //NOM_DARR_H
+
+#ifdef NOM_IMPLEMENTATION
+#include "nom_darr.c"
+#endif //NOM_IMPLEMENTATION
@@ -24,7 +24,7 @@
 #endif
 
 #ifndef NOM_REBUILD_YOURSELF_FLAGS
-    #define NOM_REBUILD_YOURSELF_FLAGS "-Wall", "-Wextra", "-pedantic", "-Wshadow", "-Wformat=2", "-Wno-unused-parameter", "-Wno-unused-function", "-Wno-implicit-fallthrough"
+    #define NOM_REBUILD_YOURSELF_FLAGS "-Wall", "-Wextra", "-pedantic", "-Wshadow", "-Wformat=2", "-pthread", "-Wno-unused-parameter", "-Wno-unused-function", "-Wno-implicit-fallthrough"
 #endif
 
 #define NOM_FREE_CONST(ptr) NOM_FREE((void *)(uintptr_t)ptr)
@@ -0,0 +1,63 @@
+#ifndef NOM_DEQUEUE_C
+#define NOM_DEQUEUE_C
+
+#include "nom_dequeue.h"
+
+void *internal_nom_deq_grow(void *items, size_t *cap, size_t *left, size_t *right, size_t n, size_t item_size) {
+    size_t old_cap = *cap;
+    size_t len = *right - *left;
+
+    NOM_ASSERT(n <= SIZE_MAX - len && "dequeue length overflow");
+    size_t new_cap = old_cap == 0 ? NOM_DEQ_INIT_CAP : old_cap;
+    while(new_cap < len + n) {
+        NOM_ASSERT(new_cap <= SIZE_MAX/2 && "dequeue capacity overflow");
+        new_cap *= 2;
+    }
+    NOM_ASSERT(new_cap <= SIZE_MAX/item_size && "dequeue size overflow");
+
+    char *tmp = NOM_REALLOC(items, new_cap*item_size);
+    NOM_ASSERT(tmp != NULL && "realloc failed");
+
+    // Renumber the counters so they start at the current left slot. With the new mask, the
+    // items that wrapped around the old end must then continue right after it.
+    size_t head = old_cap == 0 ? 0 : *left & (old_cap - 1);
+    if(head + len > old_cap) {
+        size_t wrapped = head + len - old_cap;
+        memcpy(tmp + old_cap*item_size, tmp, wrapped*item_size);
+    }
+
+    *left = head;
+    *right = head + len;
+    *cap = new_cap;
+    return tmp;
+}
+
+void internal_nom_deq_copy_in(void *items, size_t cap, size_t pos, const void *src, size_t n, size_t item_size) {
+    if(n == 0) {
+        return;
+    }
+
+    size_t slot = pos & (cap - 1);
+    size_t first = n < cap - slot ? n : cap - slot;
+
+    memcpy((char *)items + slot*item_size, src, first*item_size);
+    if(first < n) {
+        memcpy(items, (const char *)src + first*item_size, (n - first)*item_size);
+    }
+}
+
+void internal_nom_deq_copy_out(const void *items, size_t cap, size_t pos, void *dst, size_t n, size_t item_size) {
+    if(n == 0) {
+        return;
+    }
+
+    size_t slot = pos & (cap - 1);
+    size_t first = n < cap - slot ? n : cap - slot;
+
+    memcpy(dst, (const char *)items + slot*item_size, first*item_size);
+    if(first < n) {
+        memcpy((char *)dst + first*item_size, items, (n - first)*item_size);
+    }
+}
+
+#endif //NOM_DEQUEUE_C
@@ -7,10 +7,11 @@
 #include <stdio.h>
 #include <string.h>
 
+// Initial capacity of a dequeue. Must be a power of two.
 #define NOM_DEQ_INIT_CAP 32
 
-#define INTERNAL_NOM_DEQ_TMP_VAR(q) (q)->items[(q)->cap]
-
+// Ring buffer with power of two capacity. `left` and `right` are free running counters,
+// and the slot of any of them is found by masking with `cap - 1`.
 #define nom_deq_embed(deq_type) deq_type *items; size_t cap; size_t left; size_t right
 
 #define NomDeq(deq_type) struct { nom_deq_embed(deq_type); }
@@ -18,97 +19,104 @@
 typedef NomDeq(char *) NomStrDeq;
 typedef NomDeq(const char *) NomConstStrDeq;
 
-#define nom_deq_len(q) NOM_MOD((q).right - (q).left, (q).cap)
+// Grow `items` so there is room for `n` more items, keeping them in order. Returns the new items.
+void *internal_nom_deq_grow(void *items, size_t *cap, size_t *left, size_t *right, size_t n, size_t item_size);
+
+// Copy `n` items from `src` into the ring, starting at counter `pos`
+void internal_nom_deq_copy_in(void *items, size_t cap, size_t pos, const void *src, size_t n, size_t item_size);
+
+// Copy `n` items from the ring, starting at counter `pos`, into `dst`
+void internal_nom_deq_copy_out(const void *items, size_t cap, size_t pos, void *dst, size_t n, size_t item_size);
+
+#define internal_nom_deq_slot(q, pos) ((pos) & ((q).cap - 1))
+
+#define nom_deq_len(q) ((q).right - (q).left)
 
 #define nom_deq_is_empty(q) ((q).right == (q).left)
 
-#define nom_deq_peek_r(q) ((q).items[(q).right])
-
-#define nom_deq_peek_l(q) ((q).items[(q).left])
-
-#define internal_nom_deq_resize(q)                                                                                      \
-    do {                                                                                                                \
-        size_t left = (q)->left;                                                                                        \
-        size_t old_cap = (q)->cap;                                                                                      \
-        size_t new_cap = 2*old_cap;                                                                                     \
-        size_t item_size = sizeof(*(q)->items);                                                                         \
-                                                                                                                        \
-        /* Do realloc */                                                                                                \
-        void *tmp = NOM_REALLOC((q)->items, (new_cap + 1)*item_size);                                                   \
-        NOM_ASSERT(tmp != NULL && "realloc failed");                                                                    \
-        (q)->items = tmp;                                                                                               \
-        (q)->cap = new_cap;                                                                                             \
-                                                                                                                        \
-        /* Sort items in new realloc memory */                                                                          \
-        for(size_t new_i = old_cap, old_i = left; new_i < new_cap; new_i += 1, old_i = NOM_MOD(old_i + 1, old_cap)) {   \
-            (q)->items[new_i] = (q)->items[old_i];                                                                      \
-            memset(&(q)->items[old_i], 0, item_size);                                                                   \
-        }                                                                                                               \
-                                                                                                                        \
-        /* Update indices */                                                                                            \
-        (q)->left = old_cap;                                                                                            \
-        memset(&(q)->right, 0, item_size);                                                                              \
-    } while(0)
+// Item at position `i`, counting from the left
+#define nom_deq_at(q, i) ((q).items[internal_nom_deq_slot((q), (q).left + (i))])
+
+#define nom_deq_peek_r(q) ((q).items[internal_nom_deq_slot((q), (q).right - 1)])
+
+#define nom_deq_peek_l(q) ((q).items[internal_nom_deq_slot((q), (q).left)])
 
-#define internal_nom_deq_alloc(q)                                       \
-    do {                                                                \
-        (q)->cap = NOM_DEQ_INIT_CAP;                                    \
-        (q)->items = NOM_MALLOC(((q)->cap + 1)*sizeof(*(q)->items));    \
-        NOM_ASSERT((q)->items != NULL && "malloc failed");              \
-        memset((q)->items, 0, (q)->cap*sizeof(*(q)->items));            \
+// Make sure the dequeue has room for at least `n` more items
+#define nom_deq_reserve(q, n)                                                                   \
+    do {                                                                                        \
+        size_t internal_nom_deq_n = (n);                                                        \
+        if((q)->cap - nom_deq_len(*(q)) < internal_nom_deq_n) {                                 \
+            (q)->items = internal_nom_deq_grow((q)->items, &(q)->cap, &(q)->left, &(q)->right,  \
+                    internal_nom_deq_n, sizeof(*(q)->items));                                   \
+        }                                                                                       \
     } while(0)
 
-#define nom_deq_push_r(q, e)                                    \
-    do {                                                        \
-        if((q)->cap == 0) {                                     \
-            internal_nom_deq_alloc((q));                        \
-        }                                                       \
-                                                                \
-        (q)->items[(q)->right] = (e);                           \
-        (q)->right = NOM_MOD((q)->right + 1, (q)->cap);         \
-                                                                \
-        if((q)->left == (q)->right) {                           \
-            /* Dequeue is full -> Resize */                     \
-            internal_nom_deq_resize((q));                       \
-        }                                                       \
+#define nom_deq_push_r(q, e)                                                \
+    do {                                                                    \
+        nom_deq_reserve((q), 1);                                            \
+        (q)->items[internal_nom_deq_slot(*(q), (q)->right)] = (e);          \
+        (q)->right += 1;                                                    \
     } while(0)
 
-#define nom_deq_push_l(q, e)                                    \
-    do {                                                        \
-        if(nom_deq_is_empty(*(q))) {                            \
-            nom_deq_push_r((q), (e));                           \
-            break;                                              \
-        }                                                       \
-                                                                \
-        (q)->left = NOM_MOD((q)->left - 1, (q)->cap);           \
-        (q)->items[(q)->left] = (e);                            \
-                                                                \
-        if((q)->left == (q)->right) {                           \
-            /* Dequeue is full -> Resize */                     \
-            internal_nom_deq_resize((q));                       \
-        }                                                       \
+#define nom_deq_push_l(q, e)                                                \
+    do {                                                                    \
+        nom_deq_reserve((q), 1);                                            \
+        (q)->left -= 1;                                                     \
+        (q)->items[internal_nom_deq_slot(*(q), (q)->left)] = (e);           \
     } while(0)
 
 #define nom_deq_pop_l(q) (                                                  \
         NOM_ASSERT(!nom_deq_is_empty(*(q)) && "dequeue is empty"),          \
-        INTERNAL_NOM_DEQ_TMP_VAR((q)) = (q)->items[(q)->left],              \
-        memset(&(q)->items[(q)->left], 0, sizeof(*(q)->items)),             \
-        (q)->left = NOM_MOD((q)->left + 1, (q)->cap),                       \
-        INTERNAL_NOM_DEQ_TMP_VAR((q))                                       \
+        (q)->items[internal_nom_deq_slot(*(q), (q)->left++)]                \
     )
 
 #define nom_deq_pop_r(q) (                                                  \
         NOM_ASSERT(!nom_deq_is_empty(*(q)) && "dequeue is empty"),          \
-        (q)->right = NOM_MOD((q)->right - 1, (q)->cap),                     \
-        INTERNAL_NOM_DEQ_TMP_VAR((q)) = (q)->items[(q)->right],             \
-        memset(&(q)->items[(q)->right], 0, sizeof(*(q)->items)),            \
-        INTERNAL_NOM_DEQ_TMP_VAR((q))                                       \
+        (q)->items[internal_nom_deq_slot(*(q), --(q)->right)]               \
     )
 
+// Push `n` items from the array `src` to the right, in order
+#define nom_deq_push_many_r(q, src, n)                                                          \
+    do {                                                                                        \
+        size_t internal_nom_deq_many = (n);                                                     \
+        nom_deq_reserve((q), internal_nom_deq_many);                                            \
+        internal_nom_deq_copy_in((q)->items, (q)->cap, (q)->right, (src),                       \
+                internal_nom_deq_many, sizeof(*(q)->items));                                    \
+        (q)->right += internal_nom_deq_many;                                                    \
+    } while(0)
+
+// Pop the `n` leftmost items into the array `dst`, in order
+#define nom_deq_pop_many_l(q, dst, n)                                                           \
+    do {                                                                                        \
+        size_t internal_nom_deq_many = (n);                                                     \
+        NOM_ASSERT(internal_nom_deq_many <= nom_deq_len(*(q)) && "not enough items in dequeue"); \
+        internal_nom_deq_copy_out((q)->items, (q)->cap, (q)->left, (dst),                       \
+                internal_nom_deq_many, sizeof(*(q)->items));                                    \
+        (q)->left += internal_nom_deq_many;                                                     \
+    } while(0)
+
+// Pop the `n` rightmost items into the array `dst`. They keep their order, so the rightmost one is last.
+#define nom_deq_pop_many_r(q, dst, n)                                                           \
+    do {                                                                                        \
+        size_t internal_nom_deq_many = (n);                                                     \
+        NOM_ASSERT(internal_nom_deq_many <= nom_deq_len(*(q)) && "not enough items in dequeue"); \
+        (q)->right -= internal_nom_deq_many;                                                    \
+        internal_nom_deq_copy_out((q)->items, (q)->cap, (q)->right, (dst),                      \
+                internal_nom_deq_many, sizeof(*(q)->items));                                    \
+    } while(0)
+
+// Remove all items without freeing the memory
+#define nom_deq_reset(q)                \
+    do {                                \
+        (q)->left = 0;                  \
+        (q)->right = 0;                 \
+    } while(0)
+
 #define nom_deq_free(q)                 \
     do {                                \
         if((q)->items) {                \
             NOM_FREE((q)->items);       \
+            (q)->items = NULL;          \
         }                               \
         (q)->left = 0;                  \
         (q)->right = 0;                 \
@@ -116,3 +124,7 @@ typedef NomDeq(const char *) NomConstStrDeq;
     } while(0)
 
 #endif //NOM_DEQUEUE_H
+
+#ifdef NOM_IMPLEMENTATION
+#include "nom_dequeue.c"
+#endif //NOM_IMPLEMENTATION
@@ -7,11 +7,26 @@
 #include "nom_log.h"
 #include "nom_sb.h"
 #include "nom_dequeue.h"
+#include "nom_stats.h"
 
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#ifdef __linux__
+    #include <linux/fs.h>
+    #include <sys/ioctl.h>
+    #include <sys/sendfile.h>
+    #include <sys/syscall.h>
+#endif
 
 static bool internal_nom_stat(const char *path, struct stat *statbuf) {
+    NOM_STAT_INC(stat_calls);
     if(stat(path, statbuf) < 0) {
         nom_log(NOM_ERROR,"stat on `%s` failed: %s", path, strerror(errno));
         return false;
@@ -117,6 +132,7 @@ bool nom_files_walk_tree(const char *root_dir, bool (*file_callback)(const char
             continue;
         }
 
+        NOM_STAT_INC(open_calls);
         if((dp = opendir(sb.items)) == NULL) {
             success = false;
             nom_log(NOM_ERROR,"cannot open directory `%s`: %s", sb.items, strerror(errno));
@@ -174,13 +190,14 @@ bool nom_files_read_dir(const char *dir, bool (*file_callback)(const char *path,
     struct dirent *entry;
     struct stat statbuf;
 
-    NomStringBuilder sb = {0};
+    nom_sb_inline(sb);
     nom_sb_append_str(&sb, dir);
     if(nom_sb_last(sb) != '/') {
         nom_sb_append_char(&sb, '/');
     }
     size_t sb_root_checkpoint = sb.len;
 
+    NOM_STAT_INC(open_calls);
     if((dp = opendir(dir)) == NULL) {
         success = false;
         nom_log(NOM_ERROR, "cannot open directory `%s`: %s", dir, strerror(errno));
@@ -267,7 +284,7 @@ bool nom_mkdir(const char *path) {
 
     bool ret = false;
 
-    NomStringBuilder path_sb = {0};
+    nom_sb_inline(path_sb);
     nom_sb_append_str(&path_sb, path);
     if(nom_sb_last(path_sb) == '/') {
         path_sb.items[path_sb.len - 1] = 0;
@@ -336,6 +353,7 @@ static NomStringBuilder internal_nom_read_file(const char *path, int fd) {
     char *items = NULL;
 
     const char *modes = "rb";
+    NOM_STAT_ADD(open_calls, path != NULL);
     FILE *f = path ? fopen(path, modes) : fdopen(fd, modes);
     if(f == NULL) {
         if(errno != ENOENT) {
@@ -356,6 +374,8 @@ static NomStringBuilder internal_nom_read_file(const char *path, int fd) {
         items = tmp;
         n = fread(items + len, 1, buf_size, f);
         len += n;
+        NOM_STAT_INC(read_calls);
+        NOM_STAT_ADD(bytes_read, n);
     } while(n == buf_size);
 
     if(ferror(f)) {
@@ -382,6 +402,89 @@ NomStringBuilder nom_read_fd(int fd) {
     return internal_nom_read_file(NULL, fd);
 }
 
+NomStringView nom_map_file(const char *path) {
+    NomStringView ret = {0};
+
+    NOM_STAT_INC(open_calls);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        if(errno != ENOENT) {
+            nom_log(NOM_ERROR, "Could not open `%s` for reading: %s", path, strerror(errno));
+        }
+        return ret;
+    }
+
+    struct stat statbuf;
+    NOM_STAT_INC(stat_calls);
+    if(fstat(fd, &statbuf) < 0) {
+        nom_log(NOM_ERROR, "stat on `%s` failed: %s", path, strerror(errno));
+        close(fd);
+        return ret;
+    }
+    size_t size = statbuf.st_size;
+
+    if(size >= NOM_MAP_FILE_MIN_SIZE) {
+        // Large file -> Map it
+        void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(data == MAP_FAILED) {
+            nom_log(NOM_ERROR, "Could not map `%s`: %s", path, strerror(errno));
+        } else {
+            posix_madvise(data, size, POSIX_MADV_SEQUENTIAL);
+            ret = nom_sv(data, size);
+            // Count the mapping as one read of the whole file
+            NOM_STAT_INC(read_calls);
+            NOM_STAT_ADD(bytes_read, size);
+        }
+        close(fd);
+        return ret;
+    }
+
+    // Small file -> Read it in one go into a buffer of its exact size
+    char *data = NOM_MALLOC(size + 1);
+    NOM_ASSERT(data != NULL && "malloc failed");
+
+    size_t len = 0;
+    while(len < size) {
+        ssize_t n = read(fd, data + len, size - len);
+        NOM_STAT_INC(read_calls);
+        if(n < 0) {
+            if(errno == EINTR) continue;
+            nom_log(NOM_ERROR, "Could not read `%s`: %s", path, strerror(errno));
+            NOM_FREE(data);
+            close(fd);
+            return ret;
+        }
+        if(n == 0) {
+            // File shrunk while reading
+            break;
+        }
+        len += n;
+        NOM_STAT_ADD(bytes_read, n);
+    }
+    close(fd);
+
+    if(len == 0) {
+        // Empty views are never backed by memory
+        NOM_FREE(data);
+        return nom_sv("", 0);
+    }
+
+    data[len] = 0;
+    return nom_sv(data, len);
+}
+
+void nom_unmap_file(NomStringView view) {
+    if(view.data == NULL || view.len == 0) {
+        return;
+    }
+
+    if(view.len >= NOM_MAP_FILE_MIN_SIZE) {
+        munmap((void *)(uintptr_t)view.data, view.len);
+    } else {
+        NOM_FREE_CONST(view.data);
+    }
+}
+
 bool nom_write_file(const char *path, NomStringView data) {
     bool ret = true;
 
@@ -410,6 +513,486 @@ defer:
     return ret;
 }
 
+static bool internal_nom_file_has_contents(const char *path, NomStringView data) {
+    struct stat statbuf;
+    NOM_STAT_INC(stat_calls);
+    if(stat(path, &statbuf) < 0 || !S_ISREG(statbuf.st_mode) || (size_t) statbuf.st_size != data.len) {
+        // Check size first, to avoid reading the file
+        return false;
+    }
+
+    NomStringView contents = nom_map_file(path);
+    bool ret = contents.data != NULL && nom_sv_eq(contents, data);
+    nom_unmap_file(contents);
+    return ret;
+}
+
+// Path of the temporary file that replaces `path` atomically. It lives in the same directory, so renaming is atomic.
+static NomStringBuilder internal_nom_tmp_path(const char *path) {
+    NomStringBuilder ret = {0};
+    nom_sb_append_str(&ret, path);
+    nom_sb_append_str(&ret, ".tmp.");
+    nom_sb_append_i64(&ret, getpid());
+    nom_sb_append_null(&ret);
+    return ret;
+}
+
+// Write a whole buffer into a file descriptor, retrying short writes
+static bool internal_nom_write_all(int fd, const char *buf, size_t size) {
+    while(size > 0) {
+        ssize_t n = write(fd, buf, size);
+        if(n < 0) {
+            if(errno == EINTR) continue;
+            return false;
+        }
+        size -= n;
+        buf  += n;
+    }
+    return true;
+}
+
+// Create the temporary file that will replace `path`, with the permissions of `path` if it exists
+static int internal_nom_open_tmp(const char *path, const char *tmp_path) {
+    static const mode_t mode =
+        S_IRUSR | S_IWUSR       // Owner: Read, Write
+        | S_IRGRP | S_IWGRP     // Group: Read, Write
+        | S_IROTH | S_IWOTH     // Others: Read, Write
+        ;
+
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode);
+    if(fd < 0) {
+        nom_log(NOM_ERROR, "Could not open or create file `%s` for writing: %s", tmp_path, strerror(errno));
+        return -1;
+    }
+
+    // Keep the permissions of the file being replaced
+    struct stat statbuf;
+    if(stat(path, &statbuf) == 0) {
+        fchmod(fd, statbuf.st_mode & 07777);
+    }
+    return fd;
+}
+
+static bool internal_nom_write_file_atomic(const char *path, NomStringView data) {
+    bool ret = true;
+
+    NomStringBuilder tmp_path = internal_nom_tmp_path(path);
+
+    int fd = internal_nom_open_tmp(path, tmp_path.items);
+    if(fd < 0) {
+        nom_sb_free(&tmp_path);
+        return false;
+    }
+
+    if(!internal_nom_write_all(fd, data.data, data.len)) {
+        nom_log(NOM_ERROR, "Could not write into file `%s`: %s", tmp_path.items, strerror(errno));
+        close(fd);
+        nom_return_defer(false);
+    }
+
+    if(close(fd) < 0) {
+        nom_log(NOM_ERROR, "Could not write into file `%s`: %s", tmp_path.items, strerror(errno));
+        nom_return_defer(false);
+    }
+
+    if(rename(tmp_path.items, path) < 0) {
+        nom_log(NOM_ERROR, "could not rename %s to %s: %s", tmp_path.items, path, strerror(errno));
+        nom_return_defer(false);
+    }
+
+defer:
+    if(!ret) unlink(tmp_path.items);
+    nom_sb_free(&tmp_path);
+    return ret;
+}
+
+bool nom_update_file(const char *path, NomStringView data) {
+    if(internal_nom_file_has_contents(path, data)) {
+        nom_log(NOM_INFO, "file `%s` is up to date", path);
+        return true;
+    }
+
+    if(!internal_nom_write_file_atomic(path, data)) {
+        return false;
+    }
+
+    nom_log(NOM_INFO, "updated file `%s`", path);
+    return true;
+}
+
+bool nom_file_writer_open(NomFileWriter *w, const char *path) {
+    memset(w, 0, sizeof(*w));
+    w->path = path;
+    w->fd = -1;
+    w->old = nom_map_file(path);
+    if(w->old.data == NULL) {
+        if(errno != ENOENT) {
+            // Already logged
+            return false;
+        }
+        // No current file, so nothing to match
+        w->old = nom_sv("", 0);
+    }
+    w->tmp_path = internal_nom_tmp_path(path);
+    return true;
+}
+
+// Write `len` bytes of new contents. Nothing is written while they match the current file.
+static void internal_nom_file_writer_write(NomFileWriter *w, const char *data, size_t len) {
+    if(w->failed || len == 0) {
+        return;
+    }
+
+    if(w->fd < 0) {
+        if(w->matched + len <= w->old.len && memcmp(w->old.data + w->matched, data, len) == 0) {
+            w->matched += len;
+            return;
+        }
+
+        // Contents diverge: start the temporary file with the part that matched
+        w->fd = internal_nom_open_tmp(w->path, w->tmp_path.items);
+        if(w->fd < 0) {
+            w->failed = true;
+            return;
+        }
+        if(!internal_nom_write_all(w->fd, w->old.data, w->matched)) {
+            nom_log(NOM_ERROR, "Could not write into file `%s`: %s", w->tmp_path.items, strerror(errno));
+            w->failed = true;
+            return;
+        }
+    }
+
+    if(!internal_nom_write_all(w->fd, data, len)) {
+        nom_log(NOM_ERROR, "Could not write into file `%s`: %s", w->tmp_path.items, strerror(errno));
+        w->failed = true;
+    }
+}
+
+void nom_file_writer_flush(NomFileWriter *w) {
+    size_t chunks = w->buf.len / NOM_FILE_WRITER_CHUNK_SIZE * NOM_FILE_WRITER_CHUNK_SIZE;
+    if(chunks == 0) {
+        return;
+    }
+
+    internal_nom_file_writer_write(w, w->buf.items, chunks);
+
+    // Keep the remainder for the next chunk
+    memmove(w->buf.items, w->buf.items + chunks, w->buf.len - chunks);
+    w->buf.len -= chunks;
+}
+
+static void internal_nom_file_writer_free(NomFileWriter *w) {
+    if(w->fd >= 0) {
+        close(w->fd);
+        w->fd = -1;
+    }
+    nom_unmap_file(w->old);
+    w->old = nom_sv("", 0);
+    nom_sb_free(&w->buf);
+    nom_sb_free(&w->tmp_path);
+}
+
+bool nom_file_writer_close(NomFileWriter *w) {
+    bool ret = true;
+
+    internal_nom_file_writer_write(w, w->buf.items, w->buf.len);
+    w->buf.len = 0;
+    if(w->failed) nom_return_defer(false);
+
+    if(w->fd < 0) {
+        if(w->matched == w->old.len) {
+            nom_log(NOM_INFO, "file `%s` is up to date", w->path);
+            nom_return_defer(true);
+        }
+
+        // New contents are a prefix of the current ones
+        w->fd = internal_nom_open_tmp(w->path, w->tmp_path.items);
+        if(w->fd < 0) nom_return_defer(false);
+        if(!internal_nom_write_all(w->fd, w->old.data, w->matched)) {
+            nom_log(NOM_ERROR, "Could not write into file `%s`: %s", w->tmp_path.items, strerror(errno));
+            nom_return_defer(false);
+        }
+    }
+
+    int fd = w->fd;
+    w->fd = -1;
+    if(close(fd) < 0) {
+        nom_log(NOM_ERROR, "Could not write into file `%s`: %s", w->tmp_path.items, strerror(errno));
+        nom_return_defer(false);
+    }
+
+    if(rename(w->tmp_path.items, w->path) < 0) {
+        nom_log(NOM_ERROR, "could not rename %s to %s: %s", w->tmp_path.items, w->path, strerror(errno));
+        nom_return_defer(false);
+    }
+    nom_log(NOM_INFO, "updated file `%s`", w->path);
+
+defer:
+    if(!ret) unlink(w->tmp_path.items);
+    internal_nom_file_writer_free(w);
+    return ret;
+}
+
+void nom_file_writer_abort(NomFileWriter *w) {
+    if(w->fd >= 0) {
+        unlink(w->tmp_path.items);
+    }
+    internal_nom_file_writer_free(w);
+}
+
+// Copy `size` bytes from the current offset of `src_fd` into `dst_fd`. Try to keep the data inside the kernel.
+static bool internal_nom_copy_fd(int src_fd, int dst_fd, size_t size) {
+#ifdef FICLONE
+    // Reflink: share the data blocks between both files (btrfs, xfs)
+    if(ioctl(dst_fd, FICLONE, src_fd) == 0) {
+        return true;
+    }
+#endif
+
+#ifdef __NR_copy_file_range
+    // In kernel copy. May also reflink or do a server side copy.
+    while(size > 0) {
+        ssize_t n = syscall(__NR_copy_file_range, src_fd, NULL, dst_fd, NULL, size, 0);
+        if(n <= 0) {
+            if(n < 0 && errno == EINTR) continue;
+            // Not supported for these files. Fallback with the rest.
+            break;
+        }
+        size -= n;
+    }
+    if(size == 0) {
+        return true;
+    }
+#endif
+
+#ifdef __linux__
+    // In kernel copy through the page cache
+    while(size > 0) {
+        ssize_t n = sendfile(dst_fd, src_fd, NULL, size);
+        if(n <= 0) {
+            if(n < 0 && errno == EINTR) continue;
+            break;
+        }
+        size -= n;
+    }
+    if(size == 0) {
+        return true;
+    }
+#endif
+
+    // Buffered copy
+    static const size_t buf_size = 64*1024;
+    char *buf = NOM_MALLOC(buf_size);
+    NOM_ASSERT(buf != NULL && "malloc failed");
+
+    bool ret = true;
+    while(size > 0) {
+        ssize_t n = read(src_fd, buf, size < buf_size ? size : buf_size);
+        if(n < 0) {
+            if(errno == EINTR) continue;
+            nom_return_defer(false);
+        }
+        if(n == 0) {
+            // File shrunk while copying
+            break;
+        }
+        size -= n;
+
+        for(ssize_t written = 0; written < n;) {
+            ssize_t m = write(dst_fd, buf + written, n - written);
+            if(m < 0) {
+                if(errno == EINTR) continue;
+                nom_return_defer(false);
+            }
+            written += m;
+        }
+    }
+
+defer:
+    NOM_FREE(buf);
+    return ret;
+}
+
+// Check if `dst_path` already is a copy of the file described by `src_stat`
+static bool internal_nom_is_copy(const char *src_path, const struct stat *src_stat, const char *dst_path) {
+    struct stat dst_stat;
+    if(stat(dst_path, &dst_stat) < 0 || !S_ISREG(dst_stat.st_mode) || dst_stat.st_size != src_stat->st_size) {
+        return false;
+    }
+
+    if((dst_stat.st_mode & 07777) != (src_stat->st_mode & 07777)) {
+        return false;
+    }
+
+    // Copies keep the source mtime, so there is no need to read them
+    if(dst_stat.st_mtim.tv_sec == src_stat->st_mtim.tv_sec && dst_stat.st_mtim.tv_nsec == src_stat->st_mtim.tv_nsec) {
+        return true;
+    }
+
+    NomStringView src = nom_map_file(src_path);
+    NomStringView dst = nom_map_file(dst_path);
+    bool ret = src.data != NULL && dst.data != NULL && nom_sv_eq(src, dst);
+    nom_unmap_file(src);
+    nom_unmap_file(dst);
+    return ret;
+}
+
+bool nom_copy_file(const char *src_path, const char *dst_path) {
+    bool ret = true;
+
+    int src_fd = open(src_path, O_RDONLY | O_CLOEXEC);
+    if(src_fd < 0) {
+        nom_log(NOM_ERROR, "Could not open `%s` for reading: %s", src_path, strerror(errno));
+        return false;
+    }
+
+    struct stat src_stat;
+    if(fstat(src_fd, &src_stat) < 0) {
+        nom_log(NOM_ERROR, "stat on `%s` failed: %s", src_path, strerror(errno));
+        close(src_fd);
+        return false;
+    }
+    if(!S_ISREG(src_stat.st_mode)) {
+        nom_log(NOM_ERROR, "could not copy `%s`: not a regular file", src_path);
+        close(src_fd);
+        return false;
+    }
+
+    if(internal_nom_is_copy(src_path, &src_stat, dst_path)) {
+        nom_log(NOM_DEBUG, "`%s` is up to date", dst_path);
+        close(src_fd);
+        return true;
+    }
+
+    // Copy into a temporary file and then replace the destination atomically
+    NomStringBuilder tmp_path = internal_nom_tmp_path(dst_path);
+    int dst_fd = open(tmp_path.items, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if(dst_fd < 0) {
+        nom_log(NOM_ERROR, "Could not open or create file `%s` for writing: %s", tmp_path.items, strerror(errno));
+        close(src_fd);
+        nom_sb_free(&tmp_path);
+        return false;
+    }
+
+    if(!internal_nom_copy_fd(src_fd, dst_fd, src_stat.st_size)) {
+        nom_log(NOM_ERROR, "Could not copy `%s` into `%s`: %s", src_path, tmp_path.items, strerror(errno));
+        close(dst_fd);
+        nom_return_defer(false);
+    }
+
+    // Keep permissions and times
+    const struct timespec times[2] = { src_stat.st_atim, src_stat.st_mtim };
+    if(fchmod(dst_fd, src_stat.st_mode & 07777) < 0 || futimens(dst_fd, times) < 0) {
+        nom_log(NOM_ERROR, "Could not set attributes of `%s`: %s", tmp_path.items, strerror(errno));
+        close(dst_fd);
+        nom_return_defer(false);
+    }
+
+    if(close(dst_fd) < 0) {
+        nom_log(NOM_ERROR, "Could not write into file `%s`: %s", tmp_path.items, strerror(errno));
+        nom_return_defer(false);
+    }
+
+    if(rename(tmp_path.items, dst_path) < 0) {
+        nom_log(NOM_ERROR, "could not rename %s to %s: %s", tmp_path.items, dst_path, strerror(errno));
+        nom_return_defer(false);
+    }
+
+    nom_log(NOM_INFO, "copied `%s` -> `%s`", src_path, dst_path);
+
+defer:
+    if(!ret) unlink(tmp_path.items);
+    close(src_fd);
+    nom_sb_free(&tmp_path);
+    return ret;
+}
+
+static bool internal_nom_copy_dir_elem(const char *path, NomFileType type, NomFileStats *ftw, const char *dst_dir, bool *success) {
+    nom_sb_inline(dst_path);
+    nom_sb_append_str(&dst_path, dst_dir);
+    nom_sb_append_str(&dst_path, path + ftw->base_root);
+    nom_sb_append_null(&dst_path);
+
+    switch(type) {
+        case NOM_FILE_DIR: {
+            *success = nom_mkdir(dst_path.items) && *success;
+            break;
+        }
+
+        case NOM_FILE_REG: {
+            *success = nom_copy_file(path, dst_path.items) && *success;
+            break;
+        }
+
+        case NOM_FILE_OTHER: {
+            nom_log(NOM_WARNING, "skipping copy of `%s`: not a regular file or directory", path);
+            break;
+        }
+
+        case NOM_FILE_FAILED: {
+            NOM_ASSERT(false && "unreachable");
+        }
+    }
+
+    nom_sb_free(&dst_path);
+    return true;
+}
+
+static bool internal_nom_walkable_copy_dir_elem(const char *path, NomFileType type, NomFileStats *ftw, va_list args) {
+    const char *dst_dir = va_arg(args, const char *);
+    bool *success = va_arg(args, bool *);
+
+    return internal_nom_copy_dir_elem(path, type, ftw, dst_dir, success);
+}
+
+bool nom_copy_dir(const char *src_dir, const char *dst_dir) {
+    bool success = true;
+
+    nom_sb_inline(dst_sb);
+    nom_sb_append_str(&dst_sb, dst_dir);
+    if(nom_sb_last(dst_sb) == '/') {
+        dst_sb.len--;
+    }
+    nom_sb_append_null(&dst_sb);
+
+    success = nom_files_walk_tree(src_dir, internal_nom_walkable_copy_dir_elem, dst_sb.items, &success) && success;
+
+    nom_sb_free(&dst_sb);
+    return success;
+}
+
+bool nom_install(const char *src_path, const char *dst_dir) {
+    if(!nom_mkdir(dst_dir)) {
+        return false;
+    }
+
+    size_t len = strlen(src_path);
+    while(len > 1 && src_path[len - 1] == '/') {
+        len--;
+    }
+    size_t base_name;
+    for(base_name = len; base_name > 0 && src_path[base_name - 1] != '/'; --base_name);
+
+    nom_sb_inline(dst_path);
+    nom_sb_append_str(&dst_path, dst_dir);
+    if(nom_sb_last(dst_path) != '/') {
+        nom_sb_append_char(&dst_path, '/');
+    }
+    nom_sb_append_buf(&dst_path, src_path + base_name, len - base_name);
+    nom_sb_append_null(&dst_path);
+
+    bool ret;
+    NomFileType file_type = nom_file_type(src_path);
+    switch(file_type) {
+        case NOM_FILE_FAILED: ret = false; break;
+        case NOM_FILE_DIR:    ret = nom_copy_dir(src_path, dst_path.items); break;
+        default:              ret = nom_copy_file(src_path, dst_path.items); break;
+    }
+
+    nom_sb_free(&dst_path);
+    return ret;
+}
+
 char *nom_get_cwd(void) {
     size_t size = PATH_MAX;
     char *ret = NOM_MALLOC(sizeof(*ret)*size);
@@ -431,6 +1014,7 @@ char *nom_get_cwd(void) {
 
 bool nom_file_exists(const char *file_path) {
     struct stat statbuf;
+    NOM_STAT_INC(stat_calls);
     if(stat(file_path, &statbuf) < 0) {
         if(errno == ENOENT) {
             return false;
@@ -441,62 +1025,213 @@ bool nom_file_exists(const char *file_path) {
     return true;
 }
 
-static bool internal_nom_delete_dir_elem(const char *path, NomFileType type, NomFileStats *ftw, NomStrDeq *dirs) {
-    (void) ftw; // unused
+typedef NomDarr(size_t) InternalNomOffsets;
+
+typedef struct InternalNomDeleteWorker {
+    pthread_t thread;
+    bool started;
+    int root_fd;
+    const char *root_path;
+    NomStringBuilder *subdirs;
+    InternalNomOffsets *subdir_offsets;
+    atomic_size_t *next_subdir;
+    NomStringBuilder path;
+    size_t files;
+    size_t dirs;
+    bool success;
+} InternalNomDeleteWorker;
+
+static bool internal_nom_delete_subdir(int parent_fd, const char *name, InternalNomDeleteWorker *worker);
+
+// Delete everything inside the directory `dir_fd`, whose path is in `worker->path`. Takes ownership of `dir_fd`.
+static bool internal_nom_delete_dir_contents(int dir_fd, InternalNomDeleteWorker *worker) {
+    DIR *dp = fdopendir(dir_fd);
+    if(dp == NULL) {
+        nom_log(NOM_ERROR, "cannot open directory `%s`: %s", worker->path.items, strerror(errno));
+        close(dir_fd);
+        return false;
+    }
 
-    switch(type) {
-        case NOM_FILE_REG:
-        case NOM_FILE_OTHER: {
-            if(unlink(path)) {
-                nom_log(NOM_ERROR,"cannot remove file `%s`: %s", path, strerror(errno));
-                return false;
+    bool success = true;
+    struct dirent *entry;
+    while((errno = 0, entry = readdir(dp)) != NULL) {
+        const char *name = entry->d_name;
+        if(strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            // Skip . and ..
+            continue;
+        }
+
+        // Only stat when the filesystem doesn't tell us the type
+        bool is_dir = entry->d_type == DT_DIR;
+        if(entry->d_type == DT_UNKNOWN) {
+            struct stat statbuf;
+            if(fstatat(dirfd(dp), name, &statbuf, AT_SYMLINK_NOFOLLOW) < 0) {
+                nom_log(NOM_ERROR, "stat on `%s/%s` failed: %s", worker->path.items, name, strerror(errno));
+                success = false;
+                continue;
             }
-            nom_log(NOM_INFO, "deleted file `%s`", path);
-            return true;
+            is_dir = S_ISDIR(statbuf.st_mode);
         }
 
-        case NOM_FILE_DIR: {
-            size_t len = strlen(path);
-            char *dir = NOM_MALLOC(sizeof(*path) * (len + 1));
-            NOM_ASSERT(dir != NULL && "malloc failed");
-            memcpy(dir, path, len + 1);
-            nom_deq_push_l(dirs, dir);
-            return true;
+        if(is_dir) {
+            success = internal_nom_delete_subdir(dirfd(dp), name, worker) && success;
+        } else if(unlinkat(dirfd(dp), name, 0) < 0) {
+            nom_log(NOM_ERROR, "cannot remove file `%s/%s`: %s", worker->path.items, name, strerror(errno));
+            success = false;
+        } else {
+            nom_log(NOM_DEBUG, "deleted file `%s/%s`", worker->path.items, name);
+            worker->files++;
         }
+    }
+    if(errno) {
+        nom_log(NOM_ERROR, "cannot read directory `%s`: %s", worker->path.items, strerror(errno));
+        success = false;
+    }
 
-        case NOM_FILE_FAILED: {
-            NOM_ASSERT(false && "unreachable");
+    closedir(dp);
+    return success;
+}
+
+// Delete directory `name` inside `parent_fd`, with all its contents
+static bool internal_nom_delete_subdir(int parent_fd, const char *name, InternalNomDeleteWorker *worker) {
+    size_t path_checkpoint = worker->path.len;
+    worker->path.len--;
+    nom_sb_append_char(&worker->path, '/');
+    nom_sb_append_str(&worker->path, name);
+    nom_sb_append_null(&worker->path);
+
+    bool success = false;
+    int fd = openat(parent_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if(fd < 0) {
+        nom_log(NOM_ERROR, "cannot open directory `%s`: %s", worker->path.items, strerror(errno));
+    } else if(internal_nom_delete_dir_contents(fd, worker)) {
+        if(unlinkat(parent_fd, name, AT_REMOVEDIR) < 0) {
+            nom_log(NOM_ERROR, "cannot remove dir `%s`: %s", worker->path.items, strerror(errno));
+        } else {
+            nom_log(NOM_DEBUG, "deleted directory `%s`", worker->path.items);
+            worker->dirs++;
+            success = true;
         }
     }
-    NOM_ASSERT(false && "unreachable");
+
+    worker->path.len = path_checkpoint;
+    worker->path.items[path_checkpoint - 1] = 0;
+    return success;
 }
 
-static bool internal_nom_walkable_delete_dir_elem(const char *path, NomFileType type, NomFileStats *ftw, va_list args) {
-    NomStrDeq *dirs = va_arg(args, NomStrDeq *);
+// Delete top level subdirectories until there are none left
+static void *internal_nom_delete_worker_run(void *arg) {
+    InternalNomDeleteWorker *worker = arg;
 
-    return internal_nom_delete_dir_elem(path, type, ftw, dirs);
+    nom_sb_append_str(&worker->path, worker->root_path);
+    nom_sb_append_null(&worker->path);
+
+    size_t i;
+    while((i = atomic_fetch_add(worker->next_subdir, 1)) < worker->subdir_offsets->len) {
+        const char *name = worker->subdirs->items + worker->subdir_offsets->items[i];
+        worker->success = internal_nom_delete_subdir(worker->root_fd, name, worker) && worker->success;
+    }
+
+    return NULL;
 }
 
 bool nom_delete_dir(const char *root_dir) {
-    NomStrDeq q = {0};
-    bool success = nom_files_walk_tree(root_dir, internal_nom_walkable_delete_dir_elem, &q);
+    int root_fd = open(root_dir, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if(root_fd < 0) {
+        if(errno == ENOENT) {
+            return true;
+        }
+        nom_log(NOM_ERROR, "cannot open directory `%s`: %s", root_dir, strerror(errno));
+        return false;
+    }
 
-    while(!nom_deq_is_empty(q)) {
-        char *dir = nom_deq_pop_l(&q);
-        if(success) {
-            if(rmdir(dir)) {
-                if(errno != ENOENT) {
-                    nom_log(NOM_ERROR, "cannot remove dir `%s`: %s", dir, strerror(errno));
-                    success = false;
-                }
-            } else {
-                nom_log(NOM_INFO, "deleted directory `%s`", dir);
+    DIR *dp = fdopendir(root_fd);
+    if(dp == NULL) {
+        nom_log(NOM_ERROR, "cannot open directory `%s`: %s", root_dir, strerror(errno));
+        close(root_fd);
+        return false;
+    }
+
+    bool success = true;
+    size_t files = 0;
+    size_t dirs = 0;
+
+    // Delete top level files, and collect subdirectories to split them between workers
+    NomStringBuilder subdirs = {0};
+    InternalNomOffsets subdir_offsets = {0};
+    struct dirent *entry;
+    while((errno = 0, entry = readdir(dp)) != NULL) {
+        const char *name = entry->d_name;
+        if(strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            // Skip . and ..
+            continue;
+        }
+
+        bool is_dir = entry->d_type == DT_DIR;
+        if(entry->d_type == DT_UNKNOWN) {
+            struct stat statbuf;
+            if(fstatat(root_fd, name, &statbuf, AT_SYMLINK_NOFOLLOW) < 0) {
+                nom_log(NOM_ERROR, "stat on `%s/%s` failed: %s", root_dir, name, strerror(errno));
+                success = false;
+                continue;
             }
+            is_dir = S_ISDIR(statbuf.st_mode);
+        }
+
+        if(is_dir) {
+            nom_darr_append(&subdir_offsets, subdirs.len);
+            nom_sb_append_str(&subdirs, name);
+            nom_sb_append_null(&subdirs);
+        } else if(unlinkat(root_fd, name, 0) < 0) {
+            nom_log(NOM_ERROR, "cannot remove file `%s/%s`: %s", root_dir, name, strerror(errno));
+            success = false;
+        } else {
+            nom_log(NOM_DEBUG, "deleted file `%s/%s`", root_dir, name);
+            files++;
         }
-        NOM_FREE(dir);
+    }
+    if(errno) {
+        nom_log(NOM_ERROR, "cannot read directory `%s`: %s", root_dir, strerror(errno));
+        success = false;
     }
 
-    nom_deq_free(&q);
+    // Delete subdirectories in parallel. This thread is worker 0.
+    long nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t workers_count = nprocs > 0 ? (size_t) nprocs : 1;
+    if(workers_count > NOM_DELETE_MAX_THREADS) workers_count = NOM_DELETE_MAX_THREADS;
+    if(workers_count > subdir_offsets.len) workers_count = subdir_offsets.len;
+
+    atomic_size_t next_subdir = 0;
+    InternalNomDeleteWorker workers[NOM_DELETE_MAX_THREADS] = {0};
+    for(size_t i = 0; i < workers_count; ++i) {
+        InternalNomDeleteWorker *worker = &workers[i];
+        worker->root_fd = root_fd;
+        worker->root_path = root_dir;
+        worker->subdirs = &subdirs;
+        worker->subdir_offsets = &subdir_offsets;
+        worker->next_subdir = &next_subdir;
+        worker->success = true;
+
+        // If it fails to start, its share is left to the other workers
+        worker->started = i > 0 && pthread_create(&worker->thread, NULL, internal_nom_delete_worker_run, worker) == 0;
+    }
+    if(workers_count > 0) {
+        internal_nom_delete_worker_run(&workers[0]);
+    }
+    for(size_t i = 0; i < workers_count; ++i) {
+        InternalNomDeleteWorker *worker = &workers[i];
+        if(worker->started) {
+            pthread_join(worker->thread, NULL);
+        }
+        success = success && worker->success;
+        files += worker->files;
+        dirs += worker->dirs;
+        nom_sb_free(&worker->path);
+    }
+
+    closedir(dp);
+    nom_sb_free(&subdirs);
+    nom_darr_free(&subdir_offsets);
 
     if(success) {
         if(rmdir(root_dir)) {
@@ -505,13 +1240,92 @@ bool nom_delete_dir(const char *root_dir) {
                 success = false;
             }
         } else {
-            nom_log(NOM_INFO, "deleted directory `%s", root_dir);
+            dirs++;
         }
     }
 
+    nom_log(NOM_INFO, "deleted directory `%s` (%zu files, %zu directories)", root_dir, files, dirs);
     return success;
 }
 
+static bool internal_nom_delete_stale_trash(const char *path, NomFileType type, NomFileStats *ftw, va_list args) {
+    NomStringView prefix = va_arg(args, NomStringView);
+
+    if(type == NOM_FILE_DIR && nom_sv_starts_with(nom_sv_from_str(path + ftw->base_name), prefix)) {
+        nom_delete_dir(path);
+    }
+    return true;
+}
+
+bool nom_delete_dir_async(const char *root_dir) {
+    // Hidden sibling of the directory, so renaming doesn't cross filesystems
+    size_t len = strlen(root_dir);
+    while(len > 1 && root_dir[len - 1] == '/') {
+        len--;
+    }
+    size_t base_name;
+    for(base_name = len; base_name > 0 && root_dir[base_name - 1] != '/'; --base_name);
+
+    nom_sb_inline(trash);
+    nom_sb_append_buf(&trash, root_dir, base_name);
+    nom_sb_append_char(&trash, '.');
+    nom_sb_append_buf(&trash, root_dir + base_name, len - base_name);
+    nom_sb_append_str(&trash, ".nom-trash.");
+    nom_sb_append_i64(&trash, getpid());
+    nom_sb_append_null(&trash);
+
+    if(rename(root_dir, trash.items) < 0) {
+        nom_sb_free(&trash);
+        if(errno == ENOENT) {
+            return true;
+        }
+        // Couldn't move it out of the way (ex: it is a mount point). Delete it right away.
+        return nom_delete_dir(root_dir);
+    }
+
+    // Double fork, so the deleting process is adopted by init and never becomes a zombie
+    fflush(NULL);
+    pid_t child = fork();
+    if(child < 0) {
+        nom_log(NOM_WARNING, "could not fork to delete `%s` in the background: %s", root_dir, strerror(errno));
+        bool ret = nom_delete_dir(trash.items);
+        nom_sb_free(&trash);
+        return ret;
+    }
+
+    if(child == 0) {
+        if(fork() != 0) {
+            _exit(0);
+        }
+        setsid();
+        // Let go of the caller's terminal and pipes, so `./build clean | tee log` doesn't wait for it
+        int null_fd = open("/dev/null", O_RDWR);
+        if(null_fd >= 0) {
+            dup2(null_fd, STDIN_FILENO);
+            dup2(null_fd, STDOUT_FILENO);
+            dup2(null_fd, STDERR_FILENO);
+            if(null_fd > STDERR_FILENO) close(null_fd);
+        }
+        nom_log_set_level(NOM_ERROR);
+        bool ok = nom_delete_dir(trash.items);
+
+        // Trash left behind by background deletes that were killed
+        trash.len = base_name;
+        nom_sb_append_null(&trash);
+        nom_sb_inline(prefix);
+        nom_sb_append_char(&prefix, '.');
+        nom_sb_append_buf(&prefix, root_dir + base_name, len - base_name);
+        nom_sb_append_str(&prefix, ".nom-trash.");
+        nom_files_read_dir(base_name > 0 ? trash.items : ".", internal_nom_delete_stale_trash, nom_sb_to_sv(prefix));
+        _exit(ok ? 0 : 1);
+    }
+
+    waitpid(child, NULL, 0);
+    nom_log(NOM_INFO, "deleting directory `%s` in the background", root_dir);
+    nom_sb_free(&trash);
+    return true;
+}
+
 bool nom_delete(const char *path) {
     struct stat statbuf;
     if(stat(path, &statbuf) < 0) {
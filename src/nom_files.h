@@ -1,6 +1,7 @@
 #ifndef NOM_FILES_H
 #define NOM_FILES_H
 
+#include "nom_sb.h"
 #include "nom_sv.h"
 
 #include <stdarg.h>
@@ -38,8 +39,73 @@ NomStringBuilder nom_read_file(const char *path);
 
 NomStringBuilder nom_read_fd(int fd);
 
+// Files of at least this size are mmapped by nom_map_file. Smaller ones are read into the heap.
+#ifndef NOM_MAP_FILE_MIN_SIZE
+    #define NOM_MAP_FILE_MIN_SIZE (64*1024)
+#endif
+
+// Get a read-only view of the contents of a regular file, without copying it when it is large.
+// Returns a view with NULL data if the file could not be read.
+// The view must be released with nom_unmap_file.
+NomStringView nom_map_file(const char *path);
+
+// Release a view returned by nom_map_file
+void nom_unmap_file(NomStringView view);
+
 bool nom_write_file(const char *path, NomStringView data);
 
+// Write data into a file only if its contents differ, so an up to date file keeps its mtime and
+// doesn't trigger rebuilds or reindexing. Otherwise, the file is replaced atomically through a
+// temporary file, so it is never left half written. Meant for generated files.
+bool nom_update_file(const char *path, NomStringView data);
+
+// Size of the chunks written by a NomFileWriter
+#ifndef NOM_FILE_WRITER_CHUNK_SIZE
+    #define NOM_FILE_WRITER_CHUNK_SIZE (64*1024)
+#endif
+
+// Streams generated data into a file in fixed size chunks, with the same guarantees as
+// nom_update_file: the file is only replaced, atomically, if the new contents differ. While the
+// new data matches the current file nothing is written to disk at all.
+//  NomFileWriter w;
+//  if(!nom_file_writer_open(&w, path)) ...
+//  nom_sb_append_str(&w.buf, "...");    // Append with any nom_sb function
+//  nom_file_writer_flush(&w);            // Now and then, to keep memory bounded
+//  if(!nom_file_writer_close(&w)) ...
+typedef struct NomFileWriter {
+    const char *path;
+    NomStringBuilder buf;       // Pending data
+    NomStringBuilder tmp_path;
+    int fd;                     // Temporary file, or -1 while the data matches the current file
+    NomStringView old;          // Current contents of the file
+    size_t matched;             // Bytes of the current contents matched so far
+    bool failed;
+} NomFileWriter;
+
+// Start writing the new contents of `path`
+bool nom_file_writer_open(NomFileWriter *w, const char *path);
+
+// Write out the pending data in whole chunks, if there is at least one
+void nom_file_writer_flush(NomFileWriter *w);
+
+// Write out everything and replace the file if its contents changed. Returns false if anything failed,
+// in which case the file is left untouched.
+bool nom_file_writer_close(NomFileWriter *w);
+
+// Stop writing, leaving the file untouched
+void nom_file_writer_abort(NomFileWriter *w);
+
+// Copy a regular file, keeping its permissions and times. Does nothing if the destination is
+// already an identical copy. The data is copied inside the kernel when possible (reflink,
+// copy_file_range or sendfile), and the destination is replaced atomically.
+bool nom_copy_file(const char *src_path, const char *dst_path);
+
+// Copy a directory tree into dst_dir
+bool nom_copy_dir(const char *src_dir, const char *dst_dir);
+
+// Copy a file or directory tree into dst_dir, creating it if needed
+bool nom_install(const char *src_path, const char *dst_dir);
+
 // Get malloced cwd string
 char *nom_get_cwd(void);
 
@@ -47,6 +113,19 @@ bool nom_file_exists(const char *file_path);
 
 bool nom_delete(const char *path);
 
+// Max number of threads nom_delete_dir splits a directory tree between
+#ifndef NOM_DELETE_MAX_THREADS
+    #define NOM_DELETE_MAX_THREADS 8
+#endif
+
+// Delete a directory with all its contents. Its subdirectories are deleted in parallel.
+bool nom_delete_dir(const char *root_dir);
+
+// Move a directory out of the way and delete it in a background process, so it returns instantly.
+// It is moved to a hidden sibling, `.<name>.nom-trash.<pid>`. The background process also deletes
+// the siblings left behind by earlier calls whose process was killed.
+bool nom_delete_dir_async(const char *root_dir);
+
 bool nom_rename(const char *old_path, const char *new_path);
 
 #endif //NOM_FILES_H
@@ -0,0 +1,209 @@
+#ifndef NOM_HASHMAP_C
+#define NOM_HASHMAP_C
+
+#include "nom_hashmap.h"
+
+#include <string.h>
+
+#define INTERNAL_NOM_HASH_C1 0x87c37b91114253d5ull
+#define INTERNAL_NOM_HASH_C2 0x4cf5ad432745937full
+
+static inline uint64_t internal_nom_hash_rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t internal_nom_hash_fmix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+static inline uint64_t internal_nom_hash_word(uint64_t h, uint64_t k) {
+    k *= INTERNAL_NOM_HASH_C1;
+    k = internal_nom_hash_rotl(k, 31);
+    k *= INTERNAL_NOM_HASH_C2;
+    h ^= k;
+    return internal_nom_hash_rotl(h, 27)*5 + 0x52dce729;
+}
+
+// Murmur3 style hash, 8 bytes at a time
+uint64_t nom_hash_bytes(const void *data, size_t len) {
+    const unsigned char *p = data;
+    uint64_t h = 0x9e3779b97f4a7c15ull;
+    uint64_t k;
+
+    size_t n = len;
+    for(; n >= 8; n -= 8, p += 8) {
+        memcpy(&k, p, 8);
+        h = internal_nom_hash_word(h, k);
+    }
+    if(n > 0) {
+        k = 0;
+        memcpy(&k, p, n);
+        h = internal_nom_hash_word(h, k);
+    }
+
+    return internal_nom_hash_fmix(h ^ len);
+}
+
+uint64_t nom_hash_str(const char *str) {
+    return nom_hash_bytes(str, strlen(str));
+}
+
+uint64_t nom_hash_sv(NomStringView sv) {
+    return nom_hash_bytes(sv.data, sv.len);
+}
+
+static uint64_t internal_nom_hm_hash(const NomHashMapBase *hm, size_t key_size, const void *key) {
+    uint64_t h;
+    switch(hm->key) {
+        case NOM_HASH_KEY_BYTES:    h = nom_hash_bytes(key, key_size); break;
+        case NOM_HASH_KEY_STR:      h = nom_hash_str(*(const char * const *) key); break;
+        case NOM_HASH_KEY_SV:       h = nom_hash_sv(*(const NomStringView *) key); break;
+        default:                    NOM_ASSERT(false && "unreachable"); h = 0;
+    }
+    // 0 is reserved for empty slots
+    return h ? h : 1;
+}
+
+static bool internal_nom_hm_key_eq(const NomHashMapBase *hm, size_t key_size, const void *a, const void *b) {
+    switch(hm->key) {
+        case NOM_HASH_KEY_BYTES:    return memcmp(a, b, key_size) == 0;
+        case NOM_HASH_KEY_STR:      return strcmp(*(const char * const *) a, *(const char * const *) b) == 0;
+        case NOM_HASH_KEY_SV:       return nom_sv_eq(*(const NomStringView *) a, *(const NomStringView *) b);
+    }
+    NOM_ASSERT(false && "unreachable");
+    return false;
+}
+
+// Slot of `key`, or the empty slot where it should go
+static size_t internal_nom_hm_probe(const NomHashMapBase *hm, size_t key_size, const void *key, uint64_t hash) {
+    size_t mask = hm->cap - 1;
+    const char *keys = hm->keys;
+
+    for(size_t i = hash & mask;; i = (i + 1) & mask) {
+        uint64_t slot_hash = hm->hashes[i];
+        if(slot_hash == 0 || (slot_hash == hash && internal_nom_hm_key_eq(hm, key_size, keys + i*key_size, key))) {
+            return i;
+        }
+    }
+}
+
+size_t internal_nom_hm_find(const NomHashMapBase *hm, size_t key_size, const void *key) {
+    if(hm->len == 0) {
+        return NOM_HM_NOT_FOUND;
+    }
+
+    size_t i = internal_nom_hm_probe(hm, key_size, key, internal_nom_hm_hash(hm, key_size, key));
+    return hm->hashes[i] ? i : NOM_HM_NOT_FOUND;
+}
+
+void internal_nom_hm_reserve(NomHashMapBase *hm, size_t key_size, size_t val_size, size_t len) {
+    // Max load factor of 3/4
+    size_t new_cap = hm->cap ? hm->cap : NOM_HM_INIT_CAP;
+    while(len > new_cap - new_cap/4) {
+        NOM_ASSERT(new_cap <= SIZE_MAX/2 && "hash map capacity overflow");
+        new_cap *= 2;
+    }
+    if(new_cap == hm->cap) {
+        return;
+    }
+
+    NomHashMapBase new_hm = *hm;
+    new_hm.cap = new_cap;
+    new_hm.keys = NOM_MALLOC((new_cap + 1)*key_size);
+    NOM_ASSERT(new_hm.keys != NULL && "malloc failed");
+    new_hm.vals = NULL;
+    if(val_size > 0) {
+        new_hm.vals = NOM_MALLOC((new_cap + 1)*val_size);
+        NOM_ASSERT(new_hm.vals != NULL && "malloc failed");
+    }
+    new_hm.hashes = NOM_MALLOC(new_cap*sizeof(*new_hm.hashes));
+    NOM_ASSERT(new_hm.hashes != NULL && "malloc failed");
+    memset(new_hm.hashes, 0, new_cap*sizeof(*new_hm.hashes));
+
+    // Move items using their stored hashes
+    size_t mask = new_cap - 1;
+    for(size_t i = 0; i < hm->cap; ++i) {
+        uint64_t hash = hm->hashes[i];
+        if(hash == 0) continue;
+
+        size_t j;
+        for(j = hash & mask; new_hm.hashes[j]; j = (j + 1) & mask);
+        new_hm.hashes[j] = hash;
+        memcpy((char *) new_hm.keys + j*key_size, (char *) hm->keys + i*key_size, key_size);
+        if(val_size > 0) {
+            memcpy((char *) new_hm.vals + j*val_size, (char *) hm->vals + i*val_size, val_size);
+        }
+    }
+
+    internal_nom_hm_free(hm);
+    *hm = new_hm;
+}
+
+size_t internal_nom_hm_insert(NomHashMapBase *hm, size_t key_size, const void *key) {
+    NOM_ASSERT(hm->len < hm->cap && "hash map has no room");
+
+    uint64_t hash = internal_nom_hm_hash(hm, key_size, key);
+    size_t i = internal_nom_hm_probe(hm, key_size, key, hash);
+    if(hm->hashes[i] == 0) {
+        hm->hashes[i] = hash;
+        memcpy((char *) hm->keys + i*key_size, key, key_size);
+        hm->len++;
+    }
+    return i;
+}
+
+bool internal_nom_hm_remove(NomHashMapBase *hm, size_t key_size, size_t val_size, const void *key) {
+    size_t i = internal_nom_hm_find(hm, key_size, key);
+    if(i == NOM_HM_NOT_FOUND) {
+        return false;
+    }
+
+    // Backward shift deletion: move back the items of the cluster that may no longer be reachable
+    size_t mask = hm->cap - 1;
+    for(size_t j = (i + 1) & mask; hm->hashes[j]; j = (j + 1) & mask) {
+        size_t ideal = hm->hashes[j] & mask;
+        bool stays = i <= j ? (i < ideal && ideal <= j) : (i < ideal || ideal <= j);
+        if(stays) continue;
+
+        hm->hashes[i] = hm->hashes[j];
+        memcpy((char *) hm->keys + i*key_size, (char *) hm->keys + j*key_size, key_size);
+        if(val_size > 0) {
+            memcpy((char *) hm->vals + i*val_size, (char *) hm->vals + j*val_size, val_size);
+        }
+        i = j;
+    }
+
+    hm->hashes[i] = 0;
+    hm->len--;
+    return true;
+}
+
+size_t internal_nom_hm_next(const NomHashMapBase *hm, size_t i) {
+    for(; i < hm->cap && hm->hashes[i] == 0; ++i);
+    return i;
+}
+
+void internal_nom_hm_reset(NomHashMapBase *hm) {
+    if(hm->hashes) {
+        memset(hm->hashes, 0, hm->cap*sizeof(*hm->hashes));
+    }
+    hm->len = 0;
+}
+
+void internal_nom_hm_free(NomHashMapBase *hm) {
+    if(hm->keys) NOM_FREE(hm->keys);
+    if(hm->vals) NOM_FREE(hm->vals);
+    if(hm->hashes) NOM_FREE(hm->hashes);
+    hm->keys = NULL;
+    hm->vals = NULL;
+    hm->hashes = NULL;
+    hm->len = 0;
+    hm->cap = 0;
+}
+
+#endif //NOM_HASHMAP_C
@@ -0,0 +1,165 @@
+#ifndef NOM_HASHMAP_H
+#define NOM_HASHMAP_H
+
+#include "nom_defs.h"
+#include "nom_sv.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Initial capacity of a hash map. Always a power of two.
+#define NOM_HM_INIT_CAP 16
+
+// Index returned when a key is not in a hash map
+#define NOM_HM_NOT_FOUND ((size_t) -1)
+
+// How keys are hashed and compared
+typedef enum NomHashKey {
+    NOM_HASH_KEY_BYTES = 0,     // Byte by byte, like integers or pointers. Beware of struct padding.
+    NOM_HASH_KEY_STR,           // `const char *` NULL-terminated strings
+    NOM_HASH_KEY_SV,            // NomStringView
+} NomHashKey;
+
+// Type erased hash map. Open addressing with linear probing. The capacity is a power of two, and
+// the hash of every key is stored, so most mismatches are resolved without comparing keys.
+// Keys (and values) have an extra slot at index `cap`, used as scratch by the macros.
+typedef struct NomHashMapBase {
+    void *keys;
+    void *vals;
+    uint64_t *hashes; // 0 means empty slot
+    size_t len;
+    size_t cap;
+    NomHashKey key;
+    size_t tmp;
+} NomHashMapBase;
+
+// Declare hash map from keys of type K to values of type V.
+// Set `.base.key` on initialization for string keys. Ex: `NomHashMap(const char *, int) m = {.base.key = NOM_HASH_KEY_STR};`
+#define NomHashMap(K, V) struct { NomHashMapBase base; K *keys; V *vals; }
+
+// Declare hash set of keys of type K
+#define NomHashSet(K) struct { NomHashMapBase base; K *keys; }
+
+uint64_t nom_hash_bytes(const void *data, size_t len);
+
+uint64_t nom_hash_str(const char *str);
+
+uint64_t nom_hash_sv(NomStringView sv);
+
+size_t internal_nom_hm_find(const NomHashMapBase *hm, size_t key_size, const void *key);
+
+void internal_nom_hm_reserve(NomHashMapBase *hm, size_t key_size, size_t val_size, size_t len);
+
+size_t internal_nom_hm_insert(NomHashMapBase *hm, size_t key_size, const void *key);
+
+bool internal_nom_hm_remove(NomHashMapBase *hm, size_t key_size, size_t val_size, const void *key);
+
+size_t internal_nom_hm_next(const NomHashMapBase *hm, size_t i);
+
+void internal_nom_hm_reset(NomHashMapBase *hm);
+
+void internal_nom_hm_free(NomHashMapBase *hm);
+
+#define INTERNAL_NOM_HM_TMP_KEY(hm) (hm)->keys[(hm)->base.cap]
+
+// Number of items in a hash map or set
+#define nom_hm_len(hm) ((hm)->base.len)
+
+// Make room for at least `n` items without rehashing
+#define nom_hm_reserve(hm, n)                                                                   \
+    do {                                                                                        \
+        internal_nom_hm_reserve(&(hm)->base, sizeof(*(hm)->keys), sizeof(*(hm)->vals), (n));    \
+        (hm)->keys = (hm)->base.keys;                                                           \
+        (hm)->vals = (hm)->base.vals;                                                           \
+    } while(0)
+
+// Insert a key, or update its value if already present
+#define nom_hm_put(hm, k, v)                                                                                            \
+    do {                                                                                                                \
+        nom_hm_reserve((hm), (hm)->base.len + 1);                                                                       \
+        INTERNAL_NOM_HM_TMP_KEY((hm)) = (k);                                                                            \
+        (hm)->base.tmp = internal_nom_hm_insert(&(hm)->base, sizeof(*(hm)->keys), &INTERNAL_NOM_HM_TMP_KEY((hm)));      \
+        (hm)->vals[(hm)->base.tmp] = (v);                                                                               \
+    } while(0)
+
+// Slot index of a key, or NOM_HM_NOT_FOUND
+#define nom_hm_find(hm, k) (                                                                                \
+        (hm)->base.cap == 0 ? NOM_HM_NOT_FOUND : (                                                          \
+            INTERNAL_NOM_HM_TMP_KEY((hm)) = (k),                                                            \
+            internal_nom_hm_find(&(hm)->base, sizeof(*(hm)->keys), &INTERNAL_NOM_HM_TMP_KEY((hm)))          \
+        )                                                                                                   \
+    )
+
+// Pointer to the value of a key, or NULL if missing. Valid until the map is modified.
+#define nom_hm_get(hm, k) (                                                             \
+        ((hm)->base.tmp = nom_hm_find((hm), (k))) == NOM_HM_NOT_FOUND                   \
+            ? NULL                                                                      \
+            : &(hm)->vals[(hm)->base.tmp]                                               \
+    )
+
+#define nom_hm_contains(hm, k) (nom_hm_find((hm), (k)) != NOM_HM_NOT_FOUND)
+
+// Remove a key. Returns whether it was present.
+#define nom_hm_remove(hm, k) (                                                                                                      \
+        (hm)->base.cap == 0 ? false : (                                                                                             \
+            INTERNAL_NOM_HM_TMP_KEY((hm)) = (k),                                                                                    \
+            internal_nom_hm_remove(&(hm)->base, sizeof(*(hm)->keys), sizeof(*(hm)->vals), &INTERNAL_NOM_HM_TMP_KEY((hm)))           \
+        )                                                                                                                           \
+    )
+
+// Make room for at least `n` items in a hash set without rehashing
+#define nom_hs_reserve(hs, n)                                                   \
+    do {                                                                        \
+        internal_nom_hm_reserve(&(hs)->base, sizeof(*(hs)->keys), 0, (n));      \
+        (hs)->keys = (hs)->base.keys;                                           \
+    } while(0)
+
+// Add a key to a hash set
+#define nom_hs_add(hs, k)                                                                                       \
+    do {                                                                                                        \
+        nom_hs_reserve((hs), (hs)->base.len + 1);                                                               \
+        INTERNAL_NOM_HM_TMP_KEY((hs)) = (k);                                                                    \
+        internal_nom_hm_insert(&(hs)->base, sizeof(*(hs)->keys), &INTERNAL_NOM_HM_TMP_KEY((hs)));               \
+    } while(0)
+
+#define nom_hs_contains(hs, k) nom_hm_contains((hs), (k))
+
+// Remove a key from a hash set. Returns whether it was present.
+#define nom_hs_remove(hs, k) (                                                                              \
+        (hs)->base.cap == 0 ? false : (                                                                     \
+            INTERNAL_NOM_HM_TMP_KEY((hs)) = (k),                                                            \
+            internal_nom_hm_remove(&(hs)->base, sizeof(*(hs)->keys), 0, &INTERNAL_NOM_HM_TMP_KEY((hs)))     \
+        )                                                                                                   \
+    )
+
+// Iterate the slot indices of a hash map or set. Use them with `keys` and `vals`.
+#define nom_hm_foreach(i, hm)                                           \
+    for(size_t i = internal_nom_hm_next(&(hm)->base, 0);                \
+        i < (hm)->base.cap;                                             \
+        i = internal_nom_hm_next(&(hm)->base, i + 1))
+
+// Remove all items without freeing memory
+#define nom_hm_reset(hm) internal_nom_hm_reset(&(hm)->base)
+
+// Free all the memory of a hash map
+// It may be reused
+#define nom_hm_free(hm)                     \
+    do {                                    \
+        internal_nom_hm_free(&(hm)->base);  \
+        (hm)->keys = NULL;                  \
+        (hm)->vals = NULL;                  \
+    } while(0)
+
+// Free all the memory of a hash set
+// It may be reused
+#define nom_hs_free(hs)                     \
+    do {                                    \
+        internal_nom_hm_free(&(hs)->base);  \
+        (hs)->keys = NULL;                  \
+    } while(0)
+
+#endif //NOM_HASHMAP_H
+
+#ifdef NOM_IMPLEMENTATION
+#include "nom_hashmap.c"
+#endif //NOM_IMPLEMENTATION
@@ -0,0 +1,106 @@
+#ifndef NOM_INTERNER_C
+#define NOM_INTERNER_C
+
+#include "nom_interner.h"
+
+#include "nom_hashmap.h"
+
+#include <string.h>
+
+static void internal_nom_interner_grow(NomInterner *interner) {
+    size_t cap = interner->cap ? interner->cap*2 : NOM_INTERNER_INIT_CAP;
+    uint32_t *slots = NOM_MALLOC(cap*sizeof(*slots));
+    NOM_ASSERT(slots != NULL && "malloc failed");
+    memset(slots, 0, cap*sizeof(*slots));
+
+    // Reinsert using the stored hashes
+    size_t mask = cap - 1;
+    for(size_t id = 0; id < interner->offsets.len; ++id) {
+        size_t i;
+        for(i = interner->hashes.items[id] & mask; slots[i]; i = (i + 1) & mask);
+        slots[i] = id + 1;
+    }
+
+    if(interner->slots) NOM_FREE(interner->slots);
+    interner->slots = slots;
+    interner->cap = cap;
+}
+
+// Slot of the string, or the empty slot where it should go
+static size_t internal_nom_interner_probe(const NomInterner *interner, NomStringView str, uint64_t hash) {
+    size_t mask = interner->cap - 1;
+    for(size_t i = hash & mask;; i = (i + 1) & mask) {
+        uint32_t slot = interner->slots[i];
+        if(slot == 0) {
+            return i;
+        }
+
+        NomInternId id = slot - 1;
+        if(interner->hashes.items[id] == hash && nom_sv_eq(nom_interner_sv(interner, id), str)) {
+            return i;
+        }
+    }
+}
+
+NomInternId nom_intern(NomInterner *interner, NomStringView str) {
+    // Max load factor of 3/4
+    if(interner->offsets.len + 1 > interner->cap - interner->cap/4) {
+        internal_nom_interner_grow(interner);
+    }
+
+    uint64_t hash = nom_hash_sv(str);
+    size_t i = internal_nom_interner_probe(interner, str, hash);
+    if(interner->slots[i]) {
+        return interner->slots[i] - 1;
+    }
+
+    NOM_ASSERT(interner->offsets.len < NOM_INTERN_NONE && interner->buf.len <= UINT32_MAX && "interner is full");
+    NomInternId id = interner->offsets.len;
+    nom_darr_append(&interner->offsets, interner->buf.len);
+    nom_darr_append(&interner->hashes, hash);
+    nom_sb_append_sv(&interner->buf, str);
+    nom_sb_append_null(&interner->buf);
+    interner->slots[i] = id + 1;
+    return id;
+}
+
+NomInternId nom_intern_str(NomInterner *interner, const char *str) {
+    return nom_intern(interner, nom_sv_from_str(str));
+}
+
+NomInternId nom_interner_find(const NomInterner *interner, NomStringView str) {
+    if(interner->offsets.len == 0) {
+        return NOM_INTERN_NONE;
+    }
+
+    size_t i = internal_nom_interner_probe(interner, str, nom_hash_sv(str));
+    return interner->slots[i] ? interner->slots[i] - 1 : NOM_INTERN_NONE;
+}
+
+const char *nom_interner_str(const NomInterner *interner, NomInternId id) {
+    NOM_ASSERT(id < interner->offsets.len && "invalid intern id");
+    return interner->buf.items + interner->offsets.items[id];
+}
+
+NomStringView nom_interner_sv(const NomInterner *interner, NomInternId id) {
+    NOM_ASSERT(id < interner->offsets.len && "invalid intern id");
+    size_t start = interner->offsets.items[id];
+    size_t end = id + 1 < interner->offsets.len ? interner->offsets.items[id + 1] : interner->buf.len;
+    // Don't count the NULL terminator
+    return nom_sv(interner->buf.items + start, end - start - 1);
+}
+
+size_t nom_interner_count(const NomInterner *interner) {
+    return interner->offsets.len;
+}
+
+void nom_interner_free(NomInterner *interner) {
+    nom_sb_free(&interner->buf);
+    nom_darr_free(&interner->offsets);
+    nom_darr_free(&interner->hashes);
+    if(interner->slots) NOM_FREE(interner->slots);
+    interner->slots = NULL;
+    interner->cap = 0;
+}
+
+#endif //NOM_INTERNER_C
@@ -0,0 +1,52 @@
+#ifndef NOM_INTERNER_H
+#define NOM_INTERNER_H
+
+#include "nom_sb.h"
+
+#include <stdint.h>
+
+// Initial capacity of the lookup table of an interner. Always a power of two.
+#define NOM_INTERNER_INIT_CAP 256
+
+// ID returned when a string is not interned
+#define NOM_INTERN_NONE ((NomInternId) -1)
+
+typedef uint32_t NomInternId;
+
+// Maps strings to stable small integer IDs, so they can be compared and indexed as integers.
+// Every unique string is stored once, NULL-terminated, in a single contiguous buffer.
+typedef struct NomInterner {
+    NomStringBuilder buf;
+    NomDarr(uint32_t) offsets;  // ID -> Offset of its string in buf
+    NomDarr(uint64_t) hashes;   // ID -> Hash of its string
+    uint32_t *slots;            // ID + 1, or 0 if empty
+    size_t cap;
+} NomInterner;
+
+// Get the ID of a string, interning it if it is new
+NomInternId nom_intern(NomInterner *interner, NomStringView str);
+
+// Get the ID of a NULL-terminated string, interning it if it is new
+NomInternId nom_intern_str(NomInterner *interner, const char *str);
+
+// Get the ID of a string, or NOM_INTERN_NONE if it was never interned
+NomInternId nom_interner_find(const NomInterner *interner, NomStringView str);
+
+// Get the NULL-terminated string of an ID. Valid until the next string is interned.
+const char *nom_interner_str(const NomInterner *interner, NomInternId id);
+
+// Get the string of an ID. Valid until the next string is interned.
+NomStringView nom_interner_sv(const NomInterner *interner, NomInternId id);
+
+// Number of interned strings. IDs go from 0 to count - 1.
+size_t nom_interner_count(const NomInterner *interner);
+
+// Free all the memory of an interner
+// It may be reused
+void nom_interner_free(NomInterner *interner);
+
+#endif //NOM_INTERNER_H
+
+#ifdef NOM_IMPLEMENTATION
+#include "nom_interner.c"
+#endif //NOM_IMPLEMENTATION
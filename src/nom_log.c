@@ -4,47 +4,227 @@
 #include "nom_log.h"
 
 #include "nom_defs.h"
+#include "nom_sb.h"
+#include "nom_stats.h"
 
+#include <inttypes.h>
+#include <pthread.h>
 #include <stdarg.h>
-#include <stdbool.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
 
-static NomLogLevel internal_nom_log_level = NOM_INFO;
-static FILE *internal_nom_log_stream = NULL;
+static struct {
+    _Atomic int level;
+    _Atomic(FILE *) stream;
+    _Atomic uint64_t origin_ns;     // Start of timestamps, 0 if they are disabled
+
+    // Async mode
+    atomic_bool async;
+    bool stop;
+    pthread_t flusher;
+    pthread_mutex_t mutex;          // Protects queue and stop
+    pthread_cond_t cond;
+    NomStringBuilder queue;         // Records waiting to be written
+    pthread_mutex_t write_mutex;    // Keeps batches in order. Protects spare.
+    NomStringBuilder spare;         // Storage of the last batch written, to be reused as queue
+} internal_nom_log = {
+    .level = NOM_INFO,
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+    .write_mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static _Thread_local size_t internal_nom_log_job = NOM_LOG_NO_JOB;
 
 void nom_log_set_level(NomLogLevel level) {
-    internal_nom_log_level = level;
+    atomic_store_explicit(&internal_nom_log.level, level, memory_order_relaxed);
+}
+
+NomLogLevel nom_log_get_level(void) {
+    return atomic_load_explicit(&internal_nom_log.level, memory_order_relaxed);
 }
 
 void nom_log_set_stream(FILE *stream) {
-    internal_nom_log_stream = stream;
+    atomic_store_explicit(&internal_nom_log.stream, stream, memory_order_relaxed);
 }
 
-void nom_log(NomLogLevel level, const char *fmt, ...) {
-    if(level < internal_nom_log_level) {
-        return;
-    }
+FILE *nom_log_get_stream(void) {
+    return atomic_load_explicit(&internal_nom_log.stream, memory_order_relaxed);
+}
 
-    FILE *stream = internal_nom_log_stream ? internal_nom_log_stream : stderr;
+void nom_log_set_timestamps(bool enabled) {
+    atomic_store_explicit(&internal_nom_log.origin_ns, enabled ? nom_time_ns() : 0, memory_order_relaxed);
+}
 
+void nom_log_set_job(size_t job) {
+    internal_nom_log_job = job;
+}
+
+bool nom_log_enabled(NomLogLevel level) {
+    return (int) level >= atomic_load_explicit(&internal_nom_log.level, memory_order_relaxed);
+}
+
+static FILE *internal_nom_log_stream(void) {
+    FILE *stream = atomic_load_explicit(&internal_nom_log.stream, memory_order_relaxed);
+    return stream ? stream : stderr;
+}
+
+static const char *internal_nom_log_level_tag(NomLogLevel level) {
     switch(level) {
-        case NOM_INFO:
-            fprintf(stream, "[INFO] ");
-            break;
-        case NOM_WARNING:
-            fprintf(stream, "[WARNING] ");
-            break;
-        case NOM_ERROR:
-            fprintf(stream, "[ERROR] ");
-            break;
-        default:
-            NOM_ASSERT(false && "unreachable");
+        case NOM_DEBUG:     return "[DEBUG] ";
+        case NOM_INFO:      return "[INFO] ";
+        case NOM_WARNING:   return "[WARNING] ";
+        case NOM_ERROR:     return "[ERROR] ";
+    }
+    NOM_ASSERT(false && "unreachable");
+    return ""; // Turn off gcc warning
+}
+
+// Queue a record for the flusher. Returns false if async mode is off.
+static bool internal_nom_log_enqueue(NomLogLevel level, NomStringBuilder record) {
+    pthread_mutex_lock(&internal_nom_log.mutex);
+    bool async = atomic_load_explicit(&internal_nom_log.async, memory_order_relaxed);
+    if(async) {
+        nom_sb_append_buf(&internal_nom_log.queue, record.items, record.len);
+        if(level >= NOM_ERROR || internal_nom_log.queue.len >= NOM_LOG_FLUSH_SIZE) {
+            pthread_cond_signal(&internal_nom_log.cond);
+        }
+    }
+    pthread_mutex_unlock(&internal_nom_log.mutex);
+    return async;
+}
+
+void nom_log_write(NomLogLevel level, const char *fmt, ...) {
+    static _Thread_local char buf[NOM_LOG_LINE_SIZE];
+    NomStringBuilder record = nom_sb_from_buf(buf, sizeof(buf));
+
+    uint64_t origin_ns = atomic_load_explicit(&internal_nom_log.origin_ns, memory_order_relaxed);
+    if(origin_ns != 0) {
+        uint64_t elapsed_ms = (nom_time_ns() - origin_ns)/1000000;
+        nom_sb_appendf(&record, "[%4" PRIu64 ".%03" PRIu64 "] ", elapsed_ms/1000, elapsed_ms%1000);
+    }
+    nom_sb_append_str(&record, internal_nom_log_level_tag(level));
+    if(internal_nom_log_job != NOM_LOG_NO_JOB) {
+        nom_sb_appendf(&record, "[job %zu] ", internal_nom_log_job);
     }
 
     va_list args;
     va_start(args, fmt);
-    vfprintf(stream, fmt, args);
+    nom_sb_vappendf(&record, fmt, args);
     va_end(args);
-    fprintf(stream, "\n");
+    nom_sb_append_char(&record, '\n');
+
+    if(!atomic_load_explicit(&internal_nom_log.async, memory_order_acquire) || !internal_nom_log_enqueue(level, record)) {
+        fwrite(record.items, 1, record.len, internal_nom_log_stream());
+    }
+    nom_sb_free(&record);
+}
+
+// Write the queued records
+static void internal_nom_log_drain(void) {
+    pthread_mutex_lock(&internal_nom_log.write_mutex);
+
+    pthread_mutex_lock(&internal_nom_log.mutex);
+    NomStringBuilder batch = internal_nom_log.queue;
+    internal_nom_log.queue = internal_nom_log.spare;
+    pthread_mutex_unlock(&internal_nom_log.mutex);
+
+    if(batch.len > 0) {
+        FILE *stream = internal_nom_log_stream();
+        fwrite(batch.items, 1, batch.len, stream);
+        fflush(stream);
+    }
+    nom_sb_reset(&batch);
+    internal_nom_log.spare = batch;
+
+    pthread_mutex_unlock(&internal_nom_log.write_mutex);
+}
+
+static void *internal_nom_log_flusher_run(void *arg) {
+    (void) arg;
+
+    pthread_mutex_lock(&internal_nom_log.mutex);
+    while(!internal_nom_log.stop) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += NOM_LOG_FLUSH_INTERVAL_MS*1000000L;
+        deadline.tv_sec += deadline.tv_nsec/1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        pthread_cond_timedwait(&internal_nom_log.cond, &internal_nom_log.mutex, &deadline);
+
+        if(internal_nom_log.queue.len > 0) {
+            pthread_mutex_unlock(&internal_nom_log.mutex);
+            internal_nom_log_drain();
+            pthread_mutex_lock(&internal_nom_log.mutex);
+        }
+    }
+    pthread_mutex_unlock(&internal_nom_log.mutex);
+    return NULL;
+}
+
+// Keep the queue consistent across fork. The child has no flusher, so it goes back to writing directly.
+static void internal_nom_log_atfork_prepare(void) {
+    pthread_mutex_lock(&internal_nom_log.mutex);
+}
+
+static void internal_nom_log_atfork_parent(void) {
+    pthread_mutex_unlock(&internal_nom_log.mutex);
+}
+
+static void internal_nom_log_atfork_child(void) {
+    atomic_store_explicit(&internal_nom_log.async, false, memory_order_relaxed);
+    internal_nom_log.queue.len = 0;
+    pthread_mutex_unlock(&internal_nom_log.mutex);
+}
+
+static void internal_nom_log_register_atfork(void) {
+    pthread_atfork(internal_nom_log_atfork_prepare, internal_nom_log_atfork_parent, internal_nom_log_atfork_child);
+}
+
+bool nom_log_start_async(void) {
+    static pthread_once_t atfork_once = PTHREAD_ONCE_INIT;
+
+    if(atomic_load_explicit(&internal_nom_log.async, memory_order_relaxed)) {
+        return true;
+    }
+    pthread_once(&atfork_once, internal_nom_log_register_atfork);
+
+    internal_nom_log.stop = false;
+    int err = pthread_create(&internal_nom_log.flusher, NULL, internal_nom_log_flusher_run, NULL);
+    if(err != 0) {
+        nom_log(NOM_ERROR, "could not start log flusher thread: %s", strerror(err));
+        return false;
+    }
+    atomic_store_explicit(&internal_nom_log.async, true, memory_order_release);
+    return true;
+}
+
+void nom_log_stop_async(void) {
+    if(!atomic_load_explicit(&internal_nom_log.async, memory_order_relaxed)) {
+        return;
+    }
+
+    pthread_mutex_lock(&internal_nom_log.mutex);
+    atomic_store_explicit(&internal_nom_log.async, false, memory_order_relaxed);
+    internal_nom_log.stop = true;
+    pthread_cond_signal(&internal_nom_log.cond);
+    pthread_mutex_unlock(&internal_nom_log.mutex);
+    pthread_join(internal_nom_log.flusher, NULL);
+
+    // Records queued before async mode was turned off
+    internal_nom_log_drain();
+    nom_sb_free(&internal_nom_log.queue);
+    nom_sb_free(&internal_nom_log.spare);
+}
+
+void nom_log_flush(void) {
+    if(atomic_load_explicit(&internal_nom_log.async, memory_order_acquire)) {
+        internal_nom_log_drain();
+    } else {
+        fflush(internal_nom_log_stream());
+    }
 }
 
 #endif //NOM_LOG_C
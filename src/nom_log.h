@@ -1,19 +1,78 @@
 #ifndef NOM_LOG_H
 #define NOM_LOG_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 
 typedef enum {
-    NOM_INFO = 0,
+    NOM_DEBUG = 0,
+    NOM_INFO,
     NOM_WARNING,
     NOM_ERROR,
 } NomLogLevel;
 
+// Calls below this level are compiled out, arguments included
+#ifndef NOM_LOG_MIN_LEVEL
+    #define NOM_LOG_MIN_LEVEL NOM_DEBUG
+#endif
+
+// Size of the per-thread buffer records are formatted in. Longer records are allocated.
+#ifndef NOM_LOG_LINE_SIZE
+    #define NOM_LOG_LINE_SIZE 1024
+#endif
+
+// How often the background flusher writes, when it isn't woken earlier by an error or a full queue
+#ifndef NOM_LOG_FLUSH_INTERVAL_MS
+    #define NOM_LOG_FLUSH_INTERVAL_MS 50
+#endif
+
+// Size of the queue of records above which the flusher is woken
+#ifndef NOM_LOG_FLUSH_SIZE
+    #define NOM_LOG_FLUSH_SIZE (64*1024)
+#endif
+
+#define NOM_LOG_NO_JOB 0
+
 void nom_log_set_level(NomLogLevel level);
 
+NomLogLevel nom_log_get_level(void);
+
 void nom_log_set_stream(FILE *stream);
 
-void nom_log(NomLogLevel level, const char *fmt, ...);
+// Stream set with nom_log_set_stream. NULL means stderr.
+FILE *nom_log_get_stream(void);
+
+// Prefix records with the seconds elapsed since this call
+void nom_log_set_timestamps(bool enabled);
+
+// Tag the records of the calling thread with a job ID, until it is set to NOM_LOG_NO_JOB
+void nom_log_set_job(size_t job);
+
+// Check if records of `level` are logged. Use it to skip preparing arguments that are only logged.
+bool nom_log_enabled(NomLogLevel level);
+
+// Log a record. Each record is formatted in full, then written with a single write, so records
+// from different threads never interleave.
+#define nom_log(level, ...)                                                         \
+    do {                                                                            \
+        if((int) (level) >= (int) NOM_LOG_MIN_LEVEL && nom_log_enabled(level)) {    \
+            nom_log_write((level), __VA_ARGS__);                                    \
+        }                                                                           \
+    } while(0)
+
+// Log a record without checking the level first. Prefer nom_log.
+void nom_log_write(NomLogLevel level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// Hand records to a background thread that writes them in batches, so logging never blocks on
+// the stream. Records then may show up after the output of commands started later.
+bool nom_log_start_async(void);
+
+// Write the queued records and stop the background thread
+void nom_log_stop_async(void);
+
+// Write the queued records now
+void nom_log_flush(void);
 
 #endif //NOM_LOG_H
 
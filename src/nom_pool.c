@@ -0,0 +1,174 @@
+#ifndef NOM_POOL_C
+#define NOM_POOL_C
+
+#include "nom_pool.h"
+
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct InternalNomTask {
+    NomTaskFn fn;
+    void *arg;
+} InternalNomTask;
+
+// Worker the current thread is running as
+static _Thread_local InternalNomPoolWorker *internal_nom_pool_self = NULL;
+
+// Take a task from our own dequeue, or steal one from the others
+static InternalNomTask *internal_nom_pool_take(InternalNomPoolWorker *self) {
+    NomThreadPool *pool = self->pool;
+
+    InternalNomTask *task = nom_work_deq_pop(&self->tasks);
+    if(task == NULL) {
+        size_t start = (size_t) (self - pool->workers);
+        for(size_t i = 1; task == NULL && i < pool->workers_count; ++i) {
+            task = nom_work_deq_steal(&pool->workers[(start + i) % pool->workers_count].tasks);
+        }
+    }
+
+    if(task) {
+        atomic_fetch_sub(&pool->queued, 1);
+    }
+    return task;
+}
+
+static void internal_nom_pool_run(NomThreadPool *pool, InternalNomTask *task) {
+    task->fn(task->arg);
+    NOM_FREE(task);
+
+    if(atomic_fetch_sub(&pool->pending, 1) == 1 && atomic_load(&pool->sleepers) > 0) {
+        // Last task done: wake up nom_pool_wait
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_broadcast(&pool->wake);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+// Sleep until `done` holds or there may be tasks to take
+static void internal_nom_pool_sleep(NomThreadPool *pool, bool (*done)(NomThreadPool *)) {
+    atomic_fetch_add(&pool->sleepers, 1);
+    pthread_mutex_lock(&pool->lock);
+    while(!done(pool) && atomic_load(&pool->queued) == 0) {
+        pthread_cond_wait(&pool->wake, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    atomic_fetch_sub(&pool->sleepers, 1);
+}
+
+static bool internal_nom_pool_stopped(NomThreadPool *pool) {
+    return atomic_load(&pool->stop);
+}
+
+static bool internal_nom_pool_idle(NomThreadPool *pool) {
+    return atomic_load(&pool->pending) == 0;
+}
+
+static void *internal_nom_pool_worker_run(void *arg) {
+    InternalNomPoolWorker *self = arg;
+    NomThreadPool *pool = self->pool;
+    internal_nom_pool_self = self;
+
+    while(!atomic_load(&pool->stop)) {
+        InternalNomTask *task = internal_nom_pool_take(self);
+        if(task) {
+            internal_nom_pool_run(pool, task);
+        } else if(atomic_load(&pool->queued) > 0) {
+            // A task is being pushed somewhere, try again
+            sched_yield();
+        } else {
+            internal_nom_pool_sleep(pool, internal_nom_pool_stopped);
+        }
+    }
+
+    internal_nom_pool_self = NULL;
+    return NULL;
+}
+
+void nom_pool_init(NomThreadPool *pool, size_t threads) {
+    if(threads == 0) {
+        long nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = nprocs > 0 ? (size_t) nprocs : 1;
+    }
+    if(threads > NOM_POOL_MAX_THREADS) threads = NOM_POOL_MAX_THREADS;
+
+    memset(pool, 0, sizeof(*pool));
+    pool->workers_count = threads;
+    atomic_init(&pool->queued, 0);
+    atomic_init(&pool->pending, 0);
+    atomic_init(&pool->sleepers, 0);
+    atomic_init(&pool->stop, false);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+
+    for(size_t i = 0; i < threads; ++i) {
+        pool->workers[i].pool = pool;
+    }
+    internal_nom_pool_self = &pool->workers[0];
+
+    for(size_t i = 1; i < threads; ++i) {
+        InternalNomPoolWorker *worker = &pool->workers[i];
+        // If a thread can't be created, its share goes to the others
+        worker->started = pthread_create(&worker->thread, NULL, internal_nom_pool_worker_run, worker) == 0;
+    }
+}
+
+void nom_pool_submit(NomThreadPool *pool, NomTaskFn fn, void *arg) {
+    InternalNomPoolWorker *self = internal_nom_pool_self;
+    NOM_ASSERT(self != NULL && self->pool == pool && "task submitted from outside the pool");
+
+    InternalNomTask *task = NOM_MALLOC(sizeof(*task));
+    NOM_ASSERT(task != NULL && "malloc failed");
+    task->fn = fn;
+    task->arg = arg;
+
+    atomic_fetch_add(&pool->pending, 1);
+    atomic_fetch_add(&pool->queued, 1);
+    nom_work_deq_push(&self->tasks, task);
+
+    if(atomic_load(&pool->sleepers) > 0) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_signal(&pool->wake);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+void nom_pool_wait(NomThreadPool *pool) {
+    InternalNomPoolWorker *self = &pool->workers[0];
+    NOM_ASSERT(internal_nom_pool_self == self && "nom_pool_wait called outside the pool creator thread");
+
+    while(atomic_load(&pool->pending) > 0) {
+        InternalNomTask *task = internal_nom_pool_take(self);
+        if(task) {
+            internal_nom_pool_run(pool, task);
+        } else if(atomic_load(&pool->queued) > 0) {
+            sched_yield();
+        } else {
+            internal_nom_pool_sleep(pool, internal_nom_pool_idle);
+        }
+    }
+}
+
+void nom_pool_free(NomThreadPool *pool) {
+    nom_pool_wait(pool);
+
+    pthread_mutex_lock(&pool->lock);
+    atomic_store(&pool->stop, true);
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for(size_t i = 1; i < pool->workers_count; ++i) {
+        if(pool->workers[i].started) {
+            pthread_join(pool->workers[i].thread, NULL);
+        }
+    }
+    for(size_t i = 0; i < pool->workers_count; ++i) {
+        nom_work_deq_free(&pool->workers[i].tasks);
+    }
+
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->lock);
+    internal_nom_pool_self = NULL;
+}
+
+#endif //NOM_POOL_C
@@ -0,0 +1,57 @@
+#ifndef NOM_POOL_H
+#define NOM_POOL_H
+
+#include "nom_work_deq.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Maximum number of threads of a pool, counting the one that creates it
+#ifndef NOM_POOL_MAX_THREADS
+    #define NOM_POOL_MAX_THREADS 64
+#endif
+
+typedef struct NomThreadPool NomThreadPool;
+
+typedef void (*NomTaskFn)(void *arg);
+
+typedef struct InternalNomPoolWorker {
+    NomThreadPool *pool;
+    NomWorkDeq tasks;
+    pthread_t thread;
+    bool started;
+} InternalNomPoolWorker;
+
+// Thread pool where each thread owns a work stealing dequeue of tasks, and idle threads steal
+// from the others. The thread that creates the pool is worker 0: it submits the first tasks and
+// runs tasks too while it waits for them. Tasks may submit more tasks.
+struct NomThreadPool {
+    InternalNomPoolWorker workers[NOM_POOL_MAX_THREADS];
+    size_t workers_count;
+    atomic_size_t queued;   // Submitted tasks not yet taken by any worker
+    atomic_size_t pending;  // Submitted tasks not yet finished
+    atomic_size_t sleepers;
+    atomic_bool stop;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+};
+
+// Start a pool of `threads` threads, counting the calling one. 0 means one per online CPU.
+void nom_pool_init(NomThreadPool *pool, size_t threads);
+
+// Submit a task. Only callable from the thread that created the pool or from inside a task.
+void nom_pool_submit(NomThreadPool *pool, NomTaskFn fn, void *arg);
+
+// Run tasks until every submitted task has finished. Only callable from the thread that created the pool.
+void nom_pool_wait(NomThreadPool *pool);
+
+// Wait for all tasks, stop the threads and free the pool
+void nom_pool_free(NomThreadPool *pool);
+
+#endif //NOM_POOL_H
+
+#ifdef NOM_IMPLEMENTATION
+#include "nom_pool.c"
+#endif //NOM_IMPLEMENTATION
@@ -3,8 +3,13 @@
 
 #include "nom_sb.h"
 
+#include <stdio.h>
 #include <string.h>
 
+#ifdef __SSE2__
+    #include <emmintrin.h>
+#endif
+
 NomStringBuilder nom_sb_from_str(char *heap_str) {
     size_t len = strlen(heap_str) + 1;
     NomStringBuilder ret = {
@@ -15,33 +20,241 @@ NomStringBuilder nom_sb_from_str(char *heap_str) {
     return ret;
 }
 
+NomStringBuilder nom_sb_from_buf(char *buf, size_t cap) {
+    NomStringBuilder ret = {
+        .items = buf,
+        .len = 0,
+        .cap = cap,
+        .borrowed = true,
+    };
+    return ret;
+}
+
+// Make room for `n` more chars. Borrowed storage is moved to the heap when outgrown.
+static void internal_nom_sb_reserve(NomStringBuilder *sb, size_t n) {
+    if(sb->cap - sb->len >= n) {
+        return;
+    }
+
+    if(sb->borrowed) {
+        size_t new_cap = internal_nom_darr_grow_cap(sb->cap, sb->len, n, sizeof(char));
+        char *tmp = NOM_MALLOC(new_cap);
+        NOM_ASSERT(tmp != NULL && "malloc failed");
+        memcpy(tmp, sb->items, sb->len);
+        sb->items = tmp;
+        sb->cap = new_cap;
+        sb->borrowed = false;
+    } else {
+        sb->items = internal_nom_darr_grow(sb->items, &sb->cap, sb->len, n, sizeof(char));
+    }
+}
+
 void nom_sb_append_char(NomStringBuilder *sb, char c) {
-    nom_darr_append(sb, c);
+    internal_nom_sb_reserve(sb, 1);
+    sb->items[sb->len++] = c;
 }
 
 void nom_sb_append_buf(NomStringBuilder *sb, const char *buf, size_t len) {
-    nom_darr_append_many(sb, buf, len);
+    if(len == 0) {
+        return;
+    }
+    internal_nom_sb_reserve(sb, len);
+    memcpy(sb->items + sb->len, buf, len);
+    sb->len += len;
 }
 
 void nom_sb_append_sb(NomStringBuilder *sb, NomStringBuilder sb2) {
-    nom_darr_append_many(sb, sb2.items, sb2.len);
+    nom_sb_append_buf(sb, sb2.items, sb2.len);
 }
 
 void nom_sb_append_str(NomStringBuilder *sb, const char *str) {
-    size_t n = strlen(str);
-    nom_darr_append_many(sb, str, n);
+    nom_sb_append_buf(sb, str, strlen(str));
 }
 
 void nom_sb_append_sv(NomStringBuilder *sb, NomStringView sv) {
-    nom_darr_append_many(sb, sv.data, sv.len);
+    nom_sb_append_buf(sb, sv.data, sv.len);
 }
 
 void nom_sb_append_null(NomStringBuilder *sb) {
-    nom_darr_append(sb, 0);
+    nom_sb_append_char(sb, 0);
 }
 
 void nom_sb_append_nl(NomStringBuilder *sb) {
-    nom_darr_append(sb, '\n');
+    nom_sb_append_char(sb, '\n');
+}
+
+void nom_sb_appendf(NomStringBuilder *sb, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    nom_sb_vappendf(sb, fmt, args);
+    va_end(args);
+}
+
+void nom_sb_vappendf(NomStringBuilder *sb, const char *fmt, va_list args) {
+    va_list retry;
+    va_copy(retry, args);
+
+    // Try to render into the spare capacity, which usually fits
+    size_t spare = sb->cap - sb->len;
+    int n = vsnprintf(spare > 0 ? sb->items + sb->len : NULL, spare, fmt, args);
+    NOM_ASSERT(n >= 0 && "invalid format string");
+
+    if((size_t) n >= spare) {
+        // Didn't fit: grow to the exact size needed (plus vsnprintf's NULL) and render again
+        internal_nom_sb_reserve(sb, (size_t) n + 1);
+        vsnprintf(sb->items + sb->len, (size_t) n + 1, fmt, retry);
+    }
+    sb->len += (size_t) n;
+
+    va_end(retry);
+}
+
+void nom_sb_append_u64(NomStringBuilder *sb, uint64_t n) {
+    static const char digit_pairs[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+
+    // Render backwards, two digits at a time
+    char buf[20];
+    size_t i = sizeof(buf);
+    while(n >= 100) {
+        size_t pair = (size_t) (n % 100) * 2;
+        n /= 100;
+        buf[--i] = digit_pairs[pair + 1];
+        buf[--i] = digit_pairs[pair];
+    }
+    if(n >= 10) {
+        buf[--i] = digit_pairs[n*2 + 1];
+        buf[--i] = digit_pairs[n*2];
+    } else {
+        buf[--i] = (char) ('0' + n);
+    }
+
+    nom_sb_append_buf(sb, buf + i, sizeof(buf) - i);
+}
+
+void nom_sb_append_i64(NomStringBuilder *sb, int64_t n) {
+    if(n < 0) {
+        nom_sb_append_char(sb, '-');
+        // Negate as unsigned, so INT64_MIN works
+        nom_sb_append_u64(sb, (uint64_t) 0 - (uint64_t) n);
+    } else {
+        nom_sb_append_u64(sb, (uint64_t) n);
+    }
+}
+
+// Length of the prefix of `s` that needs no escaping in a JSON string
+static size_t internal_nom_json_safe_prefix(const char *s, size_t len) {
+    size_t i = 0;
+
+#ifdef __SSE2__
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i max_control = _mm_set1_epi8(0x1f);
+    for(; i + 16 <= len; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *) (s + i));
+        // Control chars are the ones where max(c, 0x1f) == 0x1f, as unsigned
+        __m128i control = _mm_cmpeq_epi8(_mm_max_epu8(block, max_control), max_control);
+        __m128i hits = _mm_or_si128(control, _mm_or_si128(_mm_cmpeq_epi8(block, quote), _mm_cmpeq_epi8(block, backslash)));
+        int mask = _mm_movemask_epi8(hits);
+        if(mask != 0) {
+            return i + (size_t) __builtin_ctz((unsigned) mask);
+        }
+    }
+#endif
+
+    for(; i < len; ++i) {
+        unsigned char c = (unsigned char) s[i];
+        if(c < 0x20 || c == '"' || c == '\\') {
+            break;
+        }
+    }
+    return i;
+}
+
+void nom_sb_append_json_escaped(NomStringBuilder *sb, NomStringView str) {
+    static const char hex[] = "0123456789abcdef";
+
+    const char *s = str.data;
+    size_t len = str.len;
+    while(len > 0) {
+        // Copy everything up to the next char to escape in one go
+        size_t safe = internal_nom_json_safe_prefix(s, len);
+        nom_sb_append_buf(sb, s, safe);
+        s += safe;
+        len -= safe;
+        if(len == 0) {
+            break;
+        }
+
+        unsigned char c = (unsigned char) *s;
+        switch(c) {
+            case '"':  nom_sb_append_buf(sb, "\\\"", 2); break;
+            case '\\': nom_sb_append_buf(sb, "\\\\", 2); break;
+            case '\n': nom_sb_append_buf(sb, "\\n", 2); break;
+            case '\r': nom_sb_append_buf(sb, "\\r", 2); break;
+            case '\t': nom_sb_append_buf(sb, "\\t", 2); break;
+            case '\b': nom_sb_append_buf(sb, "\\b", 2); break;
+            case '\f': nom_sb_append_buf(sb, "\\f", 2); break;
+            default: {
+                char esc[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+                nom_sb_append_buf(sb, esc, sizeof(esc));
+            } break;
+        }
+        s++;
+        len--;
+    }
+}
+
+// Whether a char can appear unquoted in a shell word
+static bool internal_nom_shell_safe_char(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || strchr("_-+=/.,:@%^", c) != NULL;
+}
+
+void nom_sb_append_shell_escaped(NomStringBuilder *sb, NomStringView str) {
+    size_t i;
+    for(i = 0; i < str.len && str.data[i] != 0 && internal_nom_shell_safe_char(str.data[i]); ++i);
+    if(str.len > 0 && i == str.len) {
+        nom_sb_append_sv(sb, str);
+        return;
+    }
+
+    // Single quote it. A single quote inside is closed, escaped and reopened: '\''
+    nom_sb_append_char(sb, '\'');
+    NomStringView rest = str;
+    while(rest.len > 0) {
+        size_t quote = nom_sv_find_char(rest, '\'');
+        if(quote == NOM_SV_NPOS) {
+            nom_sb_append_sv(sb, rest);
+            break;
+        }
+        nom_sb_append_buf(sb, rest.data, quote);
+        nom_sb_append_buf(sb, "'\\''", 4);
+        rest = nom_sv(rest.data + quote + 1, rest.len - quote - 1);
+    }
+    nom_sb_append_char(sb, '\'');
+}
+
+void nom_sb_append_char_arena(NomArena *arena, NomStringBuilder *sb, char c) {
+    nom_darr_append_arena(arena, sb, c);
+}
+
+void nom_sb_append_buf_arena(NomArena *arena, NomStringBuilder *sb, const char *buf, size_t len) {
+    nom_darr_append_many_arena(arena, sb, buf, len);
+}
+
+void nom_sb_append_str_arena(NomArena *arena, NomStringBuilder *sb, const char *str) {
+    size_t n = strlen(str);
+    nom_darr_append_many_arena(arena, sb, str, n);
+}
+
+void nom_sb_append_sv_arena(NomArena *arena, NomStringBuilder *sb, NomStringView sv) {
+    nom_darr_append_many_arena(arena, sb, sv.data, sv.len);
+}
+
+void nom_sb_append_null_arena(NomArena *arena, NomStringBuilder *sb) {
+    nom_darr_append_arena(arena, sb, 0);
 }
 
 inline NomStringBuilder nom_sb_copy(NomStringBuilder sb) {
@@ -55,6 +268,11 @@ void nom_sb_reset(NomStringBuilder *sb) {
 }
 
 void nom_sb_free(NomStringBuilder *sb) {
+    if(sb->borrowed) {
+        // Keep using the borrowed storage
+        sb->len = 0;
+        return;
+    }
     nom_darr_free(sb);
 }
 
@@ -4,13 +4,32 @@
 #include "nom_darr.h"
 #include "nom_sv.h"
 
+#include <stdarg.h>
+#include <stdint.h>
+
 typedef struct NomStringBuilder {
     nom_darr_embed(char);
+    bool borrowed; // items is caller provided storage, not heap memory
 } NomStringBuilder;
 
+// Size of the stack storage of string builders declared with nom_sb_inline
+#ifndef NOM_SB_INLINE_CAP
+    #define NOM_SB_INLINE_CAP 256
+#endif
+
+// Declare a string builder `name` backed by NOM_SB_INLINE_CAP bytes of stack storage. It only
+// allocates when it outgrows them. Use and free it like any other string builder, but don't
+// return it or keep it after the scope ends.
+#define nom_sb_inline(name)                                 \
+    char internal_nom_sb_buf_##name[NOM_SB_INLINE_CAP];     \
+    NomStringBuilder name = nom_sb_from_buf(internal_nom_sb_buf_##name, NOM_SB_INLINE_CAP)
+
 // Create string builder from malloced string
 NomStringBuilder nom_sb_from_str(char *heap_str);
 
+// Create empty string builder that uses `buf` as storage until it needs more than `cap` bytes
+NomStringBuilder nom_sb_from_buf(char *buf, size_t cap);
+
 // Append a character to the string builder
 void nom_sb_append_char(NomStringBuilder *sb, char c);
 
@@ -33,6 +52,39 @@ void nom_sb_append_null(NomStringBuilder *sb);
 // Append newline
 void nom_sb_append_nl(NomStringBuilder *sb);
 
+// Append printf style formatted text, rendered directly into the spare capacity of the string builder
+void nom_sb_appendf(NomStringBuilder *sb, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// Same as nom_sb_appendf, with a va_list
+void nom_sb_vappendf(NomStringBuilder *sb, const char *fmt, va_list args) __attribute__((format(printf, 2, 0)));
+
+// Append the decimal representation of an unsigned integer
+void nom_sb_append_u64(NomStringBuilder *sb, uint64_t n);
+
+// Append the decimal representation of a signed integer
+void nom_sb_append_i64(NomStringBuilder *sb, int64_t n);
+
+// Append a string escaped to go inside a JSON string literal. The quotes are not appended.
+void nom_sb_append_json_escaped(NomStringBuilder *sb, NomStringView str);
+
+// Append a string as a single POSIX shell word, single quoted only if it needs to
+void nom_sb_append_shell_escaped(NomStringBuilder *sb, NomStringView str);
+
+// Append a character to a string builder allocated from an arena. It must not be freed with nom_sb_free.
+void nom_sb_append_char_arena(NomArena *arena, NomStringBuilder *sb, char c);
+
+// Append a sized buffer to a string builder allocated from an arena
+void nom_sb_append_buf_arena(NomArena *arena, NomStringBuilder *sb, const char *buf, size_t len);
+
+// Append a NULL-terminated string to a string builder allocated from an arena
+void nom_sb_append_str_arena(NomArena *arena, NomStringBuilder *sb, const char *str);
+
+// Append a string view to a string builder allocated from an arena
+void nom_sb_append_sv_arena(NomArena *arena, NomStringBuilder *sb, NomStringView sv);
+
+// Append a NULL character to a string builder allocated from an arena
+void nom_sb_append_null_arena(NomArena *arena, NomStringBuilder *sb);
+
 // Copy String Builder
 NomStringBuilder nom_sb_copy(NomStringBuilder sb);
 
@@ -0,0 +1,93 @@
+#ifndef NOM_STATS_C
+#define NOM_STATS_C
+
+#include "nom_stats.h"
+
+#include "nom_log.h"
+#include "nom_sb.h"
+
+#include <string.h>
+#include <time.h>
+
+NomStats nom_stats = {0};
+
+uint64_t nom_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec*1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+void nom_stats_add_phase(const char *name, uint64_t ns) {
+#ifndef NOM_NO_STATS
+    for(size_t i = 0; i < nom_stats.phases_count; ++i) {
+        NomStatsPhase *phase = &nom_stats.phases[i];
+        if(phase->name == name || strcmp(phase->name, name) == 0) {
+            phase->ns += ns;
+            return;
+        }
+    }
+
+    if(nom_stats.phases_count < NOM_STATS_MAX_PHASES) {
+        NomStatsPhase phase = {
+            .name = name,
+            .ns = ns,
+        };
+        nom_stats.phases[nom_stats.phases_count++] = phase;
+    }
+#else
+    (void) name;
+    (void) ns;
+#endif
+}
+
+void nom_stats_reset(void) {
+    memset(&nom_stats, 0, sizeof(nom_stats));
+}
+
+// Append a duration with a readable unit
+static void internal_nom_stats_append_duration(NomStringBuilder *sb, uint64_t ns) {
+    if(ns >= 1000000000) {
+        nom_sb_appendf(sb, "%.2fs", (double) ns/1e9);
+    } else {
+        nom_sb_appendf(sb, "%.1fms", (double) ns/1e6);
+    }
+}
+
+void nom_stats_report(uint64_t total_ns) {
+    if(!NOM_STATS_ENABLED) {
+        nom_log(NOM_WARNING, "build statistics were compiled out (NOM_NO_STATS)");
+        return;
+    }
+
+    nom_sb_inline(sb);
+
+    for(size_t i = 0; i < nom_stats.phases_count; ++i) {
+        nom_sb_append_str(&sb, i == 0 ? "" : ", ");
+        nom_sb_append_str(&sb, nom_stats.phases[i].name);
+        nom_sb_append_char(&sb, ' ');
+        internal_nom_stats_append_duration(&sb, nom_stats.phases[i].ns);
+    }
+    nom_sb_append_null(&sb);
+    nom_log(NOM_INFO, "stats: phases: %s", sb.items);
+
+    nom_log(NOM_INFO, "stats: sources: %zu scanned, %zu up to date, %zu compiled",
+            nom_stats.sources_scanned, nom_stats.sources_up_to_date, nom_stats.sources_compiled);
+    nom_log(NOM_INFO, "stats: io: %zu stat, %zu open, %zu read (%zu bytes read)",
+            nom_stats.stat_calls, nom_stats.open_calls, nom_stats.read_calls, nom_stats.bytes_read);
+    nom_log(NOM_INFO, "stats: processes: %zu spawned", nom_stats.procs_spawned);
+
+    uint64_t wait_ns = nom_stats.wait_ns < total_ns ? nom_stats.wait_ns : total_ns;
+    nom_sb_reset(&sb);
+    internal_nom_stats_append_duration(&sb, total_ns);
+    nom_sb_append_str(&sb, " total, ");
+    internal_nom_stats_append_duration(&sb, wait_ns);
+    nom_sb_append_str(&sb, " waiting on children, ");
+    internal_nom_stats_append_duration(&sb, total_ns - wait_ns);
+    nom_sb_append_str(&sb, " in nom");
+    nom_sb_append_null(&sb);
+    nom_log(NOM_INFO, "stats: time: %s", sb.items);
+
+    nom_sb_free(&sb);
+}
+
+#endif //NOM_STATS_C
@@ -0,0 +1,60 @@
+#ifndef NOM_STATS_H
+#define NOM_STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Max number of distinct phases timed
+#define NOM_STATS_MAX_PHASES 16
+
+typedef struct NomStatsPhase {
+    const char *name;
+    uint64_t ns;
+} NomStatsPhase;
+
+// Counters of the work done by nom itself. Updated from the main thread only.
+// Define NOM_NO_STATS to compile all the counting out.
+typedef struct NomStats {
+    size_t sources_scanned;
+    size_t sources_up_to_date;
+    size_t sources_compiled;
+    size_t stat_calls;
+    size_t open_calls;
+    size_t read_calls;
+    size_t bytes_read;
+    size_t procs_spawned;
+    uint64_t wait_ns;           // Time blocked waiting on child processes
+    NomStatsPhase phases[NOM_STATS_MAX_PHASES];
+    size_t phases_count;
+} NomStats;
+
+extern NomStats nom_stats;
+
+#ifndef NOM_NO_STATS
+    #define NOM_STATS_ENABLED true
+    #define NOM_STAT_ADD(counter, n) (nom_stats.counter += (n))
+#else
+    #define NOM_STATS_ENABLED false
+    #define NOM_STAT_ADD(counter, n) ((void) sizeof(n))
+#endif
+
+#define NOM_STAT_INC(counter) NOM_STAT_ADD(counter, 1)
+
+// Current time in nanoseconds, from CLOCK_MONOTONIC
+uint64_t nom_time_ns(void);
+
+// Add time spent in a phase. Phases with the same name are added up.
+void nom_stats_add_phase(const char *name, uint64_t ns);
+
+// Reset all counters
+void nom_stats_reset(void);
+
+// Log a report of the counters. `total_ns` is the wall time they were collected over.
+void nom_stats_report(uint64_t total_ns);
+
+#endif //NOM_STATS_H
+
+#ifdef NOM_IMPLEMENTATION
+#include "nom_stats.c"
+#endif //NOM_IMPLEMENTATION
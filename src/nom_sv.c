@@ -4,10 +4,21 @@
 #include "nom_sv.h"
 
 #include <ctype.h>
+#include <string.h>
+
+#ifdef __SSE2__
+    #include <emmintrin.h>
+#endif
+
+// Max number of chars in a set for the SIMD path of nom_sv_find_any
+#define INTERNAL_NOM_SV_SIMD_SET_MAX 8
 
 NomStringView nom_sv_chop_by_delim(NomStringView *sv, char delim) {
-    size_t i;
-    for(i = 0; i < sv->len && sv->data[i] != delim; ++i);
+    size_t i = nom_sv_find_char(*sv, delim);
+    if(i == NOM_SV_NPOS) {
+        i = sv->len;
+    }
+    NomStringView chop = nom_sv(sv->data, i);
 
     // Update sv to after chop
     if (i < sv->len) {
@@ -20,7 +31,7 @@ NomStringView nom_sv_chop_by_delim(NomStringView *sv, char delim) {
     }
 
     // Return chop
-    return nom_sv(sv->data, i);
+    return chop;
 }
 
 NomStringView nom_sv(const char *data, size_t len) {
@@ -54,7 +65,168 @@ NomStringView nom_sv_from_str(const char *str) {
 }
 
 bool nom_sv_eq(NomStringView a, NomStringView b) {
-    return a.len == b.len && memcmp(a.data, b.data, a.len) == 0;
+    return a.len == b.len && (a.len == 0 || memcmp(a.data, b.data, a.len) == 0);
+}
+
+bool nom_sv_starts_with(NomStringView sv, NomStringView prefix) {
+    return sv.len >= prefix.len && nom_sv_eq(nom_sv(sv.data, prefix.len), prefix);
+}
+
+bool nom_sv_ends_with(NomStringView sv, NomStringView suffix) {
+    return sv.len >= suffix.len && nom_sv_eq(nom_sv(sv.data + sv.len - suffix.len, suffix.len), suffix);
+}
+
+size_t nom_sv_find_char(NomStringView sv, char c) {
+    if(sv.len == 0) {
+        return NOM_SV_NPOS;
+    }
+
+    // libc memchr is already vectorized
+    const char *found = memchr(sv.data, c, sv.len);
+    return found ? (size_t) (found - sv.data) : NOM_SV_NPOS;
+}
+
+size_t nom_sv_find(NomStringView sv, NomStringView needle) {
+    if(needle.len == 0) {
+        return 0;
+    }
+
+    // Jump between occurrences of the first char, and only then compare the rest
+    size_t i = 0;
+    while(sv.len - i >= needle.len) {
+        size_t j = nom_sv_find_char(nom_sv(sv.data + i, sv.len - i - needle.len + 1), needle.data[0]);
+        if(j == NOM_SV_NPOS) {
+            return NOM_SV_NPOS;
+        }
+        i += j;
+        if(memcmp(sv.data + i + 1, needle.data + 1, needle.len - 1) == 0) {
+            return i;
+        }
+        i++;
+    }
+    return NOM_SV_NPOS;
+}
+
+size_t nom_sv_find_any(NomStringView sv, const char *set) {
+    size_t set_len = strlen(set);
+    size_t i = 0;
+
+#ifdef __SSE2__
+    if(set_len <= INTERNAL_NOM_SV_SIMD_SET_MAX) {
+        __m128i needles[INTERNAL_NOM_SV_SIMD_SET_MAX];
+        for(size_t k = 0; k < set_len; ++k) {
+            needles[k] = _mm_set1_epi8(set[k]);
+        }
+
+        // 16 chars at a time
+        for(; i + 16 <= sv.len; i += 16) {
+            __m128i block = _mm_loadu_si128((const __m128i *) (sv.data + i));
+            __m128i hits = _mm_setzero_si128();
+            for(size_t k = 0; k < set_len; ++k) {
+                hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, needles[k]));
+            }
+            int mask = _mm_movemask_epi8(hits);
+            if(mask != 0) {
+                return i + (size_t) __builtin_ctz((unsigned) mask);
+            }
+        }
+    }
+#endif
+
+    if(i == sv.len) {
+        return NOM_SV_NPOS;
+    }
+
+    bool in_set[256] = {0};
+    for(size_t k = 0; k < set_len; ++k) {
+        in_set[(unsigned char) set[k]] = true;
+    }
+    for(; i < sv.len; ++i) {
+        if(in_set[(unsigned char) sv.data[i]]) {
+            return i;
+        }
+    }
+    return NOM_SV_NPOS;
+}
+
+NomSvSplit nom_sv_split(NomStringView sv, char delim) {
+    NomSvSplit it = {
+        .rest = sv,
+        .delim = delim,
+        .done = false,
+    };
+    return it;
+}
+
+bool nom_sv_split_next(NomSvSplit *it, NomStringView *field) {
+    if(it->done) {
+        return false;
+    }
+
+    size_t i = nom_sv_find_char(it->rest, it->delim);
+    if(i == NOM_SV_NPOS) {
+        // Last field
+        *field = it->rest;
+        it->done = true;
+        return true;
+    }
+
+    *field = nom_sv(it->rest.data, i);
+    it->rest = nom_sv(it->rest.data + i + 1, it->rest.len - i - 1);
+    return true;
+}
+
+// Length of the backslash-newline at `s`, or 0 if there is none
+static size_t internal_nom_sv_escaped_newline(const char *s, const char *end) {
+    if(s + 1 < end && s[0] == '\\' && s[1] == '\n') return 2;
+    if(s + 2 < end && s[0] == '\\' && s[1] == '\r' && s[2] == '\n') return 3;
+    return 0;
+}
+
+bool nom_sv_next_token(NomStringView *sv, NomStringView *token) {
+    const char *s = sv->data;
+    const char *end = s + sv->len;
+
+    // Skip blanks and escaped newlines
+    for(; s < end; s++) {
+        if(*s == ' ' || *s == '\t' || *s == '\r') continue;
+        size_t escaped_nl = internal_nom_sv_escaped_newline(s, end);
+        if(escaped_nl > 0) {
+            s += escaped_nl - 1;
+            continue;
+        }
+        break;
+    }
+
+    if(s == end || *s == '\n') {
+        // End of line
+        *sv = nom_sv(s, end - s);
+        return false;
+    }
+
+    // Jump to the next char that may end the token
+    const char *start = s;
+    for(;;) {
+        size_t i = nom_sv_find_any(nom_sv(s, end - s), " \t\r\n\\");
+        if(i == NOM_SV_NPOS) {
+            s = end;
+            break;
+        }
+        s += i;
+        if(*s != '\\') {
+            break;
+        }
+        if(internal_nom_sv_escaped_newline(s, end) > 0) {
+            // Escaped newline ends the token
+            break;
+        }
+        // Escaped char is part of the token
+        s += s + 1 < end ? 2 : 1;
+    }
+
+    *token = nom_sv(start, s - start);
+    *sv = nom_sv(s, end - s);
+    return true;
 }
 
 #endif //NOM_SV_C
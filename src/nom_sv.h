@@ -1,6 +1,9 @@
 #ifndef NOM_SV_H
 #define NOM_SV_H
 
+#include <stdbool.h>
+#include <stddef.h>
+
 typedef struct NomStringView {
     size_t len;
     const char *data;
@@ -8,7 +11,17 @@ typedef struct NomStringView {
 
 // USAGE: printf("SV: "NOM_SV_FMT"\n", NOM_SV_ARG(sv));
 #define NOM_SV_FMT "%.*s"
-#define NOM_SV_ARG(sv) (int) (sv).count, (sv).data
+#define NOM_SV_ARG(sv) (int) (sv).len, (sv).data
+
+// Index returned by the find functions when there is no match
+#define NOM_SV_NPOS ((size_t) -1)
+
+// Iterator over the fields of a string view separated by a delimiter
+typedef struct NomSvSplit {
+    NomStringView rest;
+    char delim;
+    bool done;
+} NomSvSplit;
 
 NomStringView nom_sv_chop_by_delim(NomStringView *sv, char delim);
 
@@ -18,6 +31,32 @@ NomStringView nom_sv_trim(NomStringView sv);
 
 bool nom_sv_eq(NomStringView a, NomStringView b);
 
+bool nom_sv_starts_with(NomStringView sv, NomStringView prefix);
+bool nom_sv_ends_with(NomStringView sv, NomStringView suffix);
+
+// Index of the first `c` in `sv`, or NOM_SV_NPOS
+size_t nom_sv_find_char(NomStringView sv, char c);
+
+// Index of the first occurrence of `needle` in `sv`, or NOM_SV_NPOS. An empty needle is found at 0.
+size_t nom_sv_find(NomStringView sv, NomStringView needle);
+
+// Index of the first char of `sv` that is in the NULL-terminated `set`, or NOM_SV_NPOS.
+// Uses SSE2 when available for sets of up to 8 chars.
+size_t nom_sv_find_any(NomStringView sv, const char *set);
+
+// Split `sv` by `delim`. Every delimiter separates two fields, so empty fields are kept.
+//  NomSvSplit it = nom_sv_split(sv, ',');
+//  NomStringView field;
+//  while(nom_sv_split_next(&it, &field)) { ... }
+NomSvSplit nom_sv_split(NomStringView sv, char delim);
+bool nom_sv_split_next(NomSvSplit *it, NomStringView *field);
+
+// Get the next token of the current line of `sv`, and advance `sv` past it. Tokens are separated
+// by blanks, and a backslash escapes the char after it (escapes are kept in the token), except
+// for a backslash-newline which is a blank. Returns false at the end of the line, leaving `sv`
+// at its newline, which the caller must skip to go on to the next line.
+bool nom_sv_next_token(NomStringView *sv, NomStringView *token);
+
 NomStringView nom_sv_from_str(const char *str);
 
 NomStringView nom_sv(const char *data, size_t len);
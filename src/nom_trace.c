@@ -0,0 +1,140 @@
+#ifndef NOM_TRACE_C
+#define NOM_TRACE_C
+
+#include "nom_trace.h"
+
+#include "nom_arena.h"
+#include "nom_darr.h"
+#include "nom_files.h"
+
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct InternalNomTraceEvent {
+    const char *name;
+    const char *cat;
+    uint64_t start_ns;
+    uint64_t end_ns;
+    size_t tid;         // 0 is nom itself, the rest are job slots
+    NomProc proc;       // Process of a job
+} InternalNomTraceEvent;
+
+static struct {
+    bool enabled;
+    const char *path;
+    uint64_t origin_ns;
+    size_t tids;
+    NomArena arena;
+    NomDarr(InternalNomTraceEvent) events;
+} internal_nom_trace = {0};
+
+void nom_trace_start(const char *path) {
+    internal_nom_trace.enabled = true;
+    internal_nom_trace.path = path;
+    internal_nom_trace.origin_ns = nom_time_ns();
+    internal_nom_trace.tids = 1;
+}
+
+bool nom_trace_enabled(void) {
+    return internal_nom_trace.enabled;
+}
+
+static void internal_nom_trace_record(const char *name, const char *cat, uint64_t start_ns, uint64_t end_ns, size_t tid, NomProc proc) {
+    InternalNomTraceEvent event = {
+        .name       = nom_arena_strdup(&internal_nom_trace.arena, name),
+        .cat        = cat,
+        .start_ns   = start_ns,
+        .end_ns     = end_ns,
+        .tid        = tid,
+        .proc       = proc,
+    };
+    nom_darr_append(&internal_nom_trace.events, event);
+    if(tid >= internal_nom_trace.tids) {
+        internal_nom_trace.tids = tid + 1;
+    }
+}
+
+NomTraceSpan nom_trace_begin(const char *name) {
+    NomTraceSpan span = {
+        .name = name,
+        .start_ns = internal_nom_trace.enabled || NOM_STATS_ENABLED ? nom_time_ns() : 0,
+    };
+    return span;
+}
+
+void nom_trace_end(NomTraceSpan span) {
+    if(!internal_nom_trace.enabled && !NOM_STATS_ENABLED) {
+        return;
+    }
+    uint64_t end_ns = nom_time_ns();
+    nom_stats_add_phase(span.name, end_ns - span.start_ns);
+    if(internal_nom_trace.enabled) {
+        internal_nom_trace_record(span.name, "phase", span.start_ns, end_ns, 0, NOM_INVALID_PROC);
+    }
+}
+
+void nom_trace_job(const char *name, uint64_t start_ns, uint64_t end_ns, size_t slot, NomProc proc) {
+    if(!internal_nom_trace.enabled) {
+        return;
+    }
+    internal_nom_trace_record(name, "job", start_ns, end_ns, slot + 1, proc);
+}
+
+// Append a duration in nanoseconds as microseconds, the unit of trace timestamps
+static void internal_nom_trace_append_us(NomStringBuilder *sb, uint64_t ns) {
+    nom_sb_appendf(sb, "%" PRIu64 ".%03u", ns/1000, (unsigned) (ns%1000));
+}
+
+bool nom_trace_stop(void) {
+    if(!internal_nom_trace.enabled) {
+        return true;
+    }
+    internal_nom_trace.enabled = false;
+
+    bool ret = true;
+    long pid = (long) getpid();
+
+    NomFileWriter out;
+    if(!nom_file_writer_open(&out, internal_nom_trace.path)) nom_return_defer(false);
+    NomStringBuilder *sb = &out.buf;
+
+    nom_sb_append_str(sb, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+
+    // Name the rows: nom itself, then one per job slot
+    for(size_t tid = 0; tid < internal_nom_trace.tids; ++tid) {
+        nom_sb_appendf(sb, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %ld, \"tid\": %zu, \"args\": {\"name\": \"",
+                tid == 0 ? "" : ",\n", pid, tid);
+        if(tid == 0) {
+            nom_sb_append_str(sb, "nom");
+        } else {
+            nom_sb_appendf(sb, "job slot %zu", tid);
+        }
+        nom_sb_append_str(sb, "\"}}");
+    }
+
+    for(size_t i = 0; i < internal_nom_trace.events.len; ++i) {
+        InternalNomTraceEvent event = internal_nom_trace.events.items[i];
+        nom_sb_append_str(sb, ",\n{\"name\": \"");
+        nom_sb_append_json_escaped(sb, nom_sv_from_str(event.name));
+        nom_sb_appendf(sb, "\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": %ld, \"tid\": %zu, \"ts\": ", event.cat, pid, event.tid);
+        internal_nom_trace_append_us(sb, event.start_ns > internal_nom_trace.origin_ns ? event.start_ns - internal_nom_trace.origin_ns : 0);
+        nom_sb_append_str(sb, ", \"dur\": ");
+        internal_nom_trace_append_us(sb, event.end_ns - event.start_ns);
+        if(event.proc != NOM_INVALID_PROC) {
+            nom_sb_appendf(sb, ", \"args\": {\"pid\": %ld}", (long) event.proc);
+        }
+        nom_sb_append_char(sb, '}');
+        nom_file_writer_flush(&out);
+    }
+
+    nom_sb_append_str(sb, "\n]}\n");
+    ret = nom_file_writer_close(&out);
+
+defer:
+    nom_darr_free(&internal_nom_trace.events);
+    nom_arena_free(&internal_nom_trace.arena);
+    return ret;
+}
+
+#endif //NOM_TRACE_C
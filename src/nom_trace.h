@@ -0,0 +1,39 @@
+#ifndef NOM_TRACE_H
+#define NOM_TRACE_H
+
+#include "nom_cmd.h"
+#include "nom_stats.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Span of time of a build phase
+typedef struct NomTraceSpan {
+    const char *name;
+    uint64_t start_ns;
+} NomTraceSpan;
+
+// Start recording build events (phases and compile jobs) in memory. nom_trace_stop writes them
+// to `path` as a Chrome trace_event JSON file, which can be loaded in Perfetto or chrome://tracing.
+// Events must be recorded from the main thread.
+void nom_trace_start(const char *path);
+
+// Stop recording and write the trace file
+bool nom_trace_stop(void);
+
+bool nom_trace_enabled(void);
+
+// Start a phase. Its time is also added to nom_stats. Does nothing if tracing and stats are disabled.
+NomTraceSpan nom_trace_begin(const char *name);
+
+// End a phase started with nom_trace_begin
+void nom_trace_end(NomTraceSpan span);
+
+// Record a job that ran in a child process. `slot` is the job slot (from 0) it was shown in.
+void nom_trace_job(const char *name, uint64_t start_ns, uint64_t end_ns, size_t slot, NomProc proc);
+
+#endif //NOM_TRACE_H
+
+#ifdef NOM_IMPLEMENTATION
+#include "nom_trace.c"
+#endif //NOM_IMPLEMENTATION
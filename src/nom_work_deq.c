@@ -0,0 +1,125 @@
+#ifndef NOM_WORK_DEQ_C
+#define NOM_WORK_DEQ_C
+
+#include "nom_work_deq.h"
+
+// Circular array of items. Thieves may read a slot concurrently with the owner, so slots are atomic.
+struct InternalNomWorkDeqBuf {
+    InternalNomWorkDeqBuf *next_retired;
+    int64_t cap;
+    _Atomic(void *) items[];
+};
+
+static InternalNomWorkDeqBuf *internal_nom_work_deq_buf_new(int64_t cap) {
+    InternalNomWorkDeqBuf *buf = NOM_MALLOC(sizeof(*buf) + (size_t) cap*sizeof(buf->items[0]));
+    NOM_ASSERT(buf != NULL && "malloc failed");
+    buf->next_retired = NULL;
+    buf->cap = cap;
+    return buf;
+}
+
+static void *internal_nom_work_deq_buf_get(InternalNomWorkDeqBuf *buf, int64_t i) {
+    return atomic_load_explicit(&buf->items[i & (buf->cap - 1)], memory_order_relaxed);
+}
+
+static void internal_nom_work_deq_buf_put(InternalNomWorkDeqBuf *buf, int64_t i, void *item) {
+    atomic_store_explicit(&buf->items[i & (buf->cap - 1)], item, memory_order_relaxed);
+}
+
+// Copy the live items into a buffer twice as big. The old one is kept until the dequeue is freed.
+static InternalNomWorkDeqBuf *internal_nom_work_deq_grow(NomWorkDeq *q, InternalNomWorkDeqBuf *old, int64_t top, int64_t bottom) {
+    InternalNomWorkDeqBuf *buf = internal_nom_work_deq_buf_new(old == NULL ? NOM_WORK_DEQ_INIT_CAP : 2*old->cap);
+    for(int64_t i = top; i < bottom; ++i) {
+        internal_nom_work_deq_buf_put(buf, i, internal_nom_work_deq_buf_get(old, i));
+    }
+
+    if(old != NULL) {
+        old->next_retired = q->retired;
+        q->retired = old;
+    }
+    atomic_store_explicit(&q->buf, buf, memory_order_release);
+    return buf;
+}
+
+void nom_work_deq_push(NomWorkDeq *q, void *item) {
+    NOM_ASSERT(item != NULL && "work dequeue items can't be NULL");
+
+    int64_t bottom = atomic_load_explicit(&q->bottom, memory_order_relaxed);
+    int64_t top = atomic_load_explicit(&q->top, memory_order_acquire);
+    InternalNomWorkDeqBuf *buf = atomic_load_explicit(&q->buf, memory_order_relaxed);
+
+    if(buf == NULL || bottom - top >= buf->cap) {
+        buf = internal_nom_work_deq_grow(q, buf, top, bottom);
+    }
+    internal_nom_work_deq_buf_put(buf, bottom, item);
+
+    // Publish the item to thieves
+    atomic_store_explicit(&q->bottom, bottom + 1, memory_order_release);
+}
+
+void *nom_work_deq_pop(NomWorkDeq *q) {
+    int64_t bottom = atomic_load_explicit(&q->bottom, memory_order_relaxed) - 1;
+    InternalNomWorkDeqBuf *buf = atomic_load_explicit(&q->buf, memory_order_relaxed);
+
+    // Claim the bottom item before looking at top, so a thief can't take it too
+    atomic_store_explicit(&q->bottom, bottom, memory_order_seq_cst);
+    int64_t top = atomic_load_explicit(&q->top, memory_order_seq_cst);
+
+    if(top > bottom) {
+        // Empty
+        atomic_store_explicit(&q->bottom, bottom + 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    void *item = internal_nom_work_deq_buf_get(buf, bottom);
+    if(top == bottom) {
+        // Last item: race thieves for it
+        if(!atomic_compare_exchange_strong_explicit(&q->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed)) {
+            item = NULL;
+        }
+        atomic_store_explicit(&q->bottom, bottom + 1, memory_order_relaxed);
+    }
+    return item;
+}
+
+void *nom_work_deq_steal(NomWorkDeq *q) {
+    for(;;) {
+        int64_t top = atomic_load_explicit(&q->top, memory_order_seq_cst);
+        int64_t bottom = atomic_load_explicit(&q->bottom, memory_order_seq_cst);
+        if(top >= bottom) {
+            // Empty
+            return NULL;
+        }
+
+        InternalNomWorkDeqBuf *buf = atomic_load_explicit(&q->buf, memory_order_acquire);
+        void *item = internal_nom_work_deq_buf_get(buf, top);
+        if(atomic_compare_exchange_strong_explicit(&q->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed)) {
+            return item;
+        }
+        // Lost the race with the owner or another thief, try again
+    }
+}
+
+size_t nom_work_deq_len(NomWorkDeq *q) {
+    int64_t bottom = atomic_load_explicit(&q->bottom, memory_order_relaxed);
+    int64_t top = atomic_load_explicit(&q->top, memory_order_relaxed);
+    return bottom > top ? (size_t) (bottom - top) : 0;
+}
+
+void nom_work_deq_free(NomWorkDeq *q) {
+    InternalNomWorkDeqBuf *buf = atomic_load_explicit(&q->buf, memory_order_relaxed);
+    if(buf) {
+        NOM_FREE(buf);
+    }
+    while(q->retired) {
+        InternalNomWorkDeqBuf *next = q->retired->next_retired;
+        NOM_FREE(q->retired);
+        q->retired = next;
+    }
+
+    atomic_store_explicit(&q->top, 0, memory_order_relaxed);
+    atomic_store_explicit(&q->bottom, 0, memory_order_relaxed);
+    atomic_store_explicit(&q->buf, NULL, memory_order_relaxed);
+}
+
+#endif //NOM_WORK_DEQ_C
@@ -0,0 +1,44 @@
+#ifndef NOM_WORK_DEQ_H
+#define NOM_WORK_DEQ_H
+
+#include "nom_defs.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Initial capacity of a work stealing dequeue. Must be a power of two.
+#define NOM_WORK_DEQ_INIT_CAP 64
+
+typedef struct InternalNomWorkDeqBuf InternalNomWorkDeqBuf;
+
+// Chase-Lev work stealing dequeue of pointers. A single owner thread pushes and pops at the
+// bottom, while any number of thieves steal from the top, without locks. The zero value is an
+// empty dequeue. Items can't be NULL.
+typedef struct NomWorkDeq {
+    _Atomic(int64_t) top;
+    _Atomic(int64_t) bottom;
+    _Atomic(InternalNomWorkDeqBuf *) buf;
+    InternalNomWorkDeqBuf *retired; // Outgrown buffers that thieves may still be reading. Owner only.
+} NomWorkDeq;
+
+// Push an item at the bottom. Owner only.
+void nom_work_deq_push(NomWorkDeq *q, void *item);
+
+// Pop the item at the bottom, or NULL if empty. Owner only.
+void *nom_work_deq_pop(NomWorkDeq *q);
+
+// Steal the item at the top, or NULL if empty. Any thread.
+void *nom_work_deq_steal(NomWorkDeq *q);
+
+// Number of items. It may be stale as soon as it is returned.
+size_t nom_work_deq_len(NomWorkDeq *q);
+
+// Free all the memory of the dequeue. No other thread may be using it.
+void nom_work_deq_free(NomWorkDeq *q);
+
+#endif //NOM_WORK_DEQ_H
+
+#ifdef NOM_IMPLEMENTATION
+#include "nom_work_deq.c"
+#endif //NOM_IMPLEMENTATION